@@ -23,39 +23,452 @@
 #define DEBUG
 #define pr_fmt(fmt) KBUILD_MODNAME ":%s: " fmt, __func__
 
+#include <linux/ctype.h>
 #include <linux/delay.h>
 #include <linux/firmware.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/idr.h>
+#include <linux/kobject.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
 #include <linux/module.h>
 #include <linux/pci.h>
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
 #include <linux/sysfs.h>
 #include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/xz.h>
 
 #include "ni6674t.h"
+#include "ni6674t_api.h"
+#include "ni6674t_ioctl.h"
 #include "ni6674t_registers.h"
 
+enum probe_phase {
+	PROBE_PHASE_MAP,
+	PROBE_PHASE_FPGA,
+	PROBE_PHASE_DAC,
+	PROBE_PHASE_TERMINALS,
+	PROBE_PHASE_ROUTING,
+	PROBE_PHASE_TOTAL,
+	NR_PROBE_PHASES,
+};
+
+#define ROUTE_SCHEDULE_MAX_STEPS	64
+
+/**
+ * struct route_step - One timed route change of a route schedule
+ *
+ * @offset_ns:	When to apply the change, relative to arming the schedule.
+ * @actual_ns:	When it was applied relative to arming, or -1 if it hasn't
+ *		been yet.
+ * @rt:		The terminal to change, with a reference held.
+ * @input:	Its new input.
+ * @polarity:	Its new polarity, or -1 to leave it alone.
+ * @skipped:	Whether the step was due while the terminal was reserved or
+ *		driving a pulse train, and so wasn't applied.
+ */
+struct route_step {
+	u64 offset_ns;
+	s64 actual_ns;
+	struct route_terminal *rt;
+	const struct route_terminal_input *input;
+	int polarity;
+	bool skipped;
+};
+
+enum route_schedule_state {
+	SCHEDULE_EMPTY,
+	SCHEDULE_LOADED,
+	SCHEDULE_ARMED,
+	SCHEDULE_DONE,
+};
+
+/* A list of route changes applied at fixed offsets from an hrtimer.  The
+ *   steps are only changed with devlock held and the timer cancelled. */
+struct route_schedule {
+	struct hrtimer timer;
+	struct work_struct notify_work;
+	enum route_schedule_state state;
+	ktime_t start;
+	unsigned int nsteps;
+	unsigned int next;
+	struct route_step steps[ROUTE_SCHEDULE_MAX_STEPS];
+};
+
+#define ROUTE_RULES_MAX			32
+/* Every sample is a timer interrupt and up to three register reads, a few
+ *   microseconds of CPU time: a few percent of a CPU at the default
+ *   period, and a quarter or more of one at the minimum. */
+#define ROUTE_RULES_DEFAULT_PERIOD_NS	100000
+#define ROUTE_RULES_MIN_PERIOD_NS	10000
+
+enum route_rule_cond {
+	RULE_RISE,
+	RULE_FALL,
+	RULE_HIGH,
+	RULE_LOW,
+};
+
+enum route_rule_state {
+	RULE_ARMED,
+	RULE_WAITING,	/* a re-arming level rule, until the level goes away */
+	RULE_SPENT,
+};
+
+/**
+ * struct route_rule - A route change applied when a line state condition
+ *		       is seen
+ *
+ * @watch:	The terminal whose line state is watched, with a reference
+ *		held.
+ * @cond:	An enum route_rule_cond.
+ * @rearm:	Whether the rule fires again after firing, rather than once.
+ * @state:	An enum route_rule_state.
+ * @rt:		The terminal to change, with a reference held.
+ * @input:	Its new input.
+ * @polarity:	Its new polarity, or -1 to leave it alone.
+ * @fires:	How many times the rule has fired.
+ * @skips:	How many times its condition was seen while the terminal to
+ *		change was reserved or driving a pulse train.
+ * @min_ns:	Shortest reaction time.
+ * @max_ns:	Longest reaction time.
+ * @sum_ns:	Sum of the reaction times.
+ */
+struct route_rule {
+	struct route_terminal *watch;
+	enum route_rule_cond cond;
+	bool rearm;
+	enum route_rule_state state;
+	struct route_terminal *rt;
+	const struct route_terminal_input *input;
+	int polarity;
+	unsigned int fires;
+	unsigned int skips;
+	u64 min_ns;
+	u64 max_ns;
+	u64 sum_ns;
+};
+
+/* Route rules, evaluated on every sample of the trigread registers taken
+ *   from an hrtimer.  The rules are only changed with devlock held and the
+ *   timer cancelled. */
+struct route_rules {
+	struct hrtimer timer;
+	struct work_struct notify_work;
+	bool running;
+	u64 period_ns;
+	u64 samples;
+	unsigned int words;	/* mask of the trigread registers sampled */
+	u32 last[3];
+	ktime_t last_sample;
+	unsigned int nrules;
+	struct route_rule rules[ROUTE_RULES_MAX];
+	DECLARE_BITMAP(fired, ROUTE_RULES_MAX);
+};
+
+enum pulse_generator_state {
+	GENERATOR_IDLE,
+	GENERATOR_ARMED,
+	GENERATOR_RUNNING,
+	GENERATOR_DONE,
+};
+
+enum pulse_generator_start {
+	GENERATOR_START_NOW,
+	GENERATOR_START_SYNC,
+};
+
+/**
+ * struct pulse_generator - Pulse train driven onto a triggerctrl terminal
+ *
+ * @timer:	Fires on every edge and rewrites triggerctrl directly.
+ * @rt:		The terminal being driven.
+ * @state:	An enum pulse_generator_state.
+ * @start:	Whether the train starts when configured or from
+ *		generator_start.
+ * @period_ns:	Pulse period.
+ * @high_ns:	Time spent asserted in each period.
+ * @count:	Number of pulses to drive, or 0 to run until stopped.
+ * @word_high:	triggerctrl word driving the line asserted.
+ * @word_low:	triggerctrl word driving the line deasserted.
+ * @high:	Whether the line is currently asserted.
+ * @pulses:	Pulses driven so far.
+ * @first_rise:	Time of the first rising edge.
+ * @last_rise:	Time of the last rising edge.
+ * @edges:	Edges driven so far.
+ * @late_sum_ns: Sum of how late each edge was written.
+ * @late_max_ns: The latest any edge was written.
+ */
+struct pulse_generator {
+	struct hrtimer timer;
+	struct route_terminal *rt;
+	enum pulse_generator_state state;
+	enum pulse_generator_start start;
+	u64 period_ns;
+	u64 high_ns;
+	unsigned int count;
+	u32 word_high;
+	u32 word_low;
+	bool high;
+	unsigned int pulses;
+	ktime_t first_rise;
+	ktime_t last_rise;
+	unsigned int edges;
+	u64 late_sum_ns;
+	u64 late_max_ns;
+};
+
+/* Whether a pulse train currently owns the terminal's triggerctrl word */
+static bool generator_active(const struct route_terminal *rt)
+{
+	return rt->generator && (rt->generator->state == GENERATOR_ARMED ||
+				 rt->generator->state == GENERATOR_RUNNING);
+}
+
+/* Whether something other than its route drives the terminal: a pulse
+ *   train, or a self-test, calibration or fired pulse that has claimed it
+ *   through busy.  Called with route_lock held. */
+static bool terminal_busy(const struct route_terminal *rt)
+{
+	return rt->busy || generator_active(rt);
+}
+
+/* Whether the terminal is reserved through an open file other than file.
+ *   Writers that aren't a file of the character device pass NULL.  Called
+ *   with route_lock held; only a hint otherwise. */
+static bool reserved_by_other(const struct route_terminal *rt,
+			      const struct file *file)
+{
+	struct file *holder = ACCESS_ONCE(rt->holder);
+
+	return holder && holder != file;
+}
+
+/* Whether the terminal is reserved by a process other than the current
+ *   one.  This is the check for sysfs writes, which carry no open file:
+ *   the holder's process may still make its own settings through sysfs.
+ *   Called with route_lock held. */
+static bool reserved_by_other_process(const struct route_terminal *rt)
+{
+	return rt->holder && rt->holder_pid != task_tgid(current);
+}
+
+/* PFI threshold calibration result for one line, in DAC codes */
+struct pfi_threshold_cal {
+	struct route_terminal *rt;
+	unsigned int low;	/* lowest threshold the line was seen low at */
+	unsigned int high;	/* highest threshold the line was seen high at */
+	unsigned int code;	/* threshold programmed after the sweep */
+	bool found;		/* whether the line toggled across a wide
+				 * enough band for code to be its midpoint */
+};
+
 struct ni6674t {
 	struct kset *terminal_set;
 
 	struct mutex devlock;
 
-	struct pxi_trig_route_terminal *pxi_trig[8];
-	struct route_terminal *pfi[6];
-	struct route_terminal *pxi_star[17];
-	struct route_terminal *srca;
-	struct route_terminal *srcb;
-	struct route_terminal *srca_div_sel;
-	struct route_terminal *srcb_div_sel;
-	struct route_terminal *pxie_dstara[17];
-	struct route_terminal *bank[4];
+	/* Protects the routing state of every terminal (input, polarity, sync
+	 * and delay settings, triggerctrl word, consumers, reservation and
+	 * busy claim), the DStarA shadows below and pulse train state
+	 * changes, and orders the register writes made from them.  Taken
+	 * from the pulse train, route schedule and route rules timers, so
+	 * always with interrupts off. */
+	spinlock_t route_lock;
+
+	/* Held for reading by ioctls and by the in-kernel interface, and for
+	 * writing while the board is taken off ni6674t_devices, so none of
+	 * them runs on a removed board */
+	struct rw_semaphore unbind_lock;
+
+	struct route_terminal_arena *terminals;
 	struct mite __iomem *mite;
 	struct ni_sync __iomem *sync;
+	struct pci_dev *pdev;
+
+	/* Shadows of the DStarA control registers, protected by route_lock */
+	u32 dstaractrl1;
+	u32 dstaractrl2;
+
+	/* Threshold DAC codes waiting to be shifted out, one per PFI line.
+	 * Writing a line that is already pending replaces its code. */
+	spinlock_t dac_lock;
+	unsigned long dac_pending;
+	u8 dac_codes[6];
+	struct work_struct dac_work;
+	/* Codes the DAC was last set to, updated once a write goes out */
+	u8 pfi_threshold[6];
+	/* Set while a threshold calibration drives the DAC itself; the queued
+	 * words wait until it is done */
+	bool dac_sweeping;
+
+	struct miscdevice miscdev;
+	int minor_id;
+
+	/* Sequence number of the last route change reported in a uevent */
+	atomic64_t route_seq;
+
+	/* Routing graph exported through the topology attributes, built once
+	 * at probe from the descriptor tables */
+	char *topology;
+	size_t topology_size;
+	void *topology_bin;
+	size_t topology_bin_size;
+
+	/* Time spent in each phase of probe, in nanoseconds */
+	u64 probe_ns[NR_PROBE_PHASES];
+
+	struct route_schedule schedule;
+	struct route_rules rules;
+
+	/* Results of the last loopback self-test, protected by devlock */
+	struct selftest_result *selftest;
+	unsigned int selftest_count;
+
+	/* Results of the last PXI delay calibration, protected by devlock */
+	struct pxi_delay_cal *pxi_cal;
+	unsigned int pxi_cal_count;
+
+	/* Results of the last PFI threshold calibration, protected by devlock */
+	struct pfi_threshold_cal pfi_cal[6];
+	unsigned int pfi_cal_count;
+
+	/* Entry in ni6674t_devices, empty once the board is removed */
+	struct list_head node;
+	/* Held by the PCI binding and by users of ni6674t_get() */
+	struct kref ref;
+};
+
+/* Loopback latency statistics for one terminal, in nanoseconds */
+struct selftest_result {
+	const struct route_terminal *rt;
+	unsigned int samples;
+	unsigned int timeouts;
+	u32 min;
+	u32 median;
+	u32 p99;
+};
+
+/* PXI delay calibration result for one terminal */
+struct pxi_delay_cal {
+	struct route_terminal *rt;
+	u32 arrival[TRIG_CTRL_PXI_DELAY_MAX + 1];
+	unsigned int delay;
+};
+
+static DEFINE_IDA(ni6674t_ida);
+
+/* Every bound board */
+static LIST_HEAD(ni6674t_devices);
+/* Protects the board and cable lists */
+static DEFINE_MUTEX(ni6674t_devices_lock);
+
+/*
+ * Driver event counters, exported through the "ni6674t" perf PMU.  They
+ * count over every board, and are kept per CPU so that the hot paths only
+ * pay for an increment.
+ */
+enum ni6674t_counter {
+	CTR_ROUTE_COMMITS,
+	CTR_POLARITY_CHANGES,
+	CTR_REJECTED_WRITES,
+	CTR_DAC_BUSY_SPINS,
+	CTR_FIFO_WORDS,
+	CTR_TRIG_READS,
+	CTR_TRIG_WRITES,
+	CTR_DSTARA_READS,
+	CTR_DSTARA_WRITES,
+	CTR_DAC_READS,
+	CTR_DAC_WRITES,
+	CTR_CLKIN_WRITES,
+	CTR_CE_READS,
+	CTR_CE_WRITES,
+	CTR_MITE_READS,
+	CTR_MITE_WRITES,
+	NR_COUNTERS,
 };
 
+static DEFINE_PER_CPU(u64, ni6674t_counters[NR_COUNTERS]);
+
+static void ni6674t_count(enum ni6674t_counter ctr)
+{
+	this_cpu_inc(ni6674t_counters[ctr]);
+}
+
+static u32 ni6674t_ioread32(enum ni6674t_counter ctr, void __iomem *addr)
+{
+	ni6674t_count(ctr);
+	return ioread32(addr);
+}
+
+static void ni6674t_iowrite32(enum ni6674t_counter ctr, u32 val,
+			      void __iomem *addr)
+{
+	ni6674t_count(ctr);
+	iowrite32(val, addr);
+}
+
+/* Sets the polarity of rt, counting it if it changes */
+static void set_terminal_polarity(struct route_terminal *rt,
+				  enum terminal_polarity polarity)
+{
+	if (rt->polarity != polarity)
+		ni6674t_count(CTR_POLARITY_CHANGES);
+	rt->polarity = polarity;
+}
+
 static const char *terminal_polarity_strs[] = {
 	[POLARITY_NORMAL]	= "normal",
 	[POLARITY_INVERTED]	= "inverted",
 };
 
+static const char *terminal_sync_mode_strs[] = {
+	[SYNC_MODE_ASYNCHRONOUS]	= "asynchronous",
+	[SYNC_MODE_SYNCHRONOUS]		= "synchronous",
+};
+
+static const char *terminal_sync_clock_strs[] = {
+	[SYNC_CLOCK_FULL]	= "full",
+	[SYNC_CLOCK_DIV1]	= "div1",
+	[SYNC_CLOCK_DIV2]	= "div2",
+};
+
+static const u32 terminal_sync_clock_regvals[] = {
+	[SYNC_CLOCK_FULL]	= TRIG_CTRL_SYNC_CLOCK_FULL,
+	[SYNC_CLOCK_DIV1]	= TRIG_CTRL_SYNC_CLOCK_DIV1,
+	[SYNC_CLOCK_DIV2]	= TRIG_CTRL_SYNC_CLOCK_DIV2,
+};
+
+/* Nominal periods of the sync clock outputs, for latency estimates: the
+ *   100 MHz backplane sync clock and its outputs divided by 2 and 4 */
+static const unsigned int terminal_sync_clock_period_ns[] = {
+	[SYNC_CLOCK_FULL]	= 10,
+	[SYNC_CLOCK_DIV1]	= 20,
+	[SYNC_CLOCK_DIV2]	= 40,
+};
+
+static const char *probe_phase_strs[] = {
+	[PROBE_PHASE_MAP]		= "map",
+	[PROBE_PHASE_FPGA]		= "fpga",
+	[PROBE_PHASE_DAC]		= "dac",
+	[PROBE_PHASE_TERMINALS]		= "terminals",
+	[PROBE_PHASE_ROUTING]		= "routing",
+	[PROBE_PHASE_TOTAL]		= "total",
+};
+
+static const char *terminal_sync_edge_strs[] = {
+	[SYNC_EDGE_RISING]	= "rising",
+	[SYNC_EDGE_FALLING]	= "falling",
+};
+
 static const struct route_terminal_desc rt_floating = {
 	.name		= "floating",
 };
@@ -68,11 +481,23 @@ static const struct route_terminal_desc rt_logic_low = {
 	.name		= "logic_low",
 };
 
-static void triggerctrl_flush_terminal_attrs(struct route_terminal *rt)
+static const struct route_terminal_desc rt_sync_clk = {
+	.name		= "SyncClk",
+};
+
+static const struct route_terminal_desc rt_global_sw = {
+	.name		= "global_software",
+};
+
+static const struct route_terminal_desc rt_local_sw = {
+	.name		= "local_software",
+};
+
+/* Computes the triggerctrl word for the terminal's current settings */
+static void triggerctrl_update_regval(struct route_terminal *rt)
 {
 	const struct route_terminal_desc *dst = rt->rt_desc;
 	const struct route_terminal_input *src = rt->input;
-	struct ni6674t *dev = rt->owner;
 	u32 trigctrl;
 
 	trigctrl = TRIG_CTRL_DEST(dst->dest_data) | TRIG_CTRL_SRC(src->data);
@@ -82,12 +507,27 @@ static void triggerctrl_flush_terminal_attrs(struct route_terminal *rt)
 	if (src->desc != &rt_floating)
 		trigctrl |= TRIG_CTRL_ENABLED;
 
-	trigctrl |= TRIG_CTRL_ASYNCHRONOUS;
+	if (rt->sync_mode == SYNC_MODE_SYNCHRONOUS) {
+		trigctrl |= TRIG_CTRL_SYNC_CLOCK(terminal_sync_clock_regvals[rt->sync_clock]);
+		if (rt->sync_edge == SYNC_EDGE_FALLING)
+			trigctrl |= TRIG_CTRL_EDGE_FALLING;
+	} else {
+		trigctrl |= TRIG_CTRL_ASYNCHRONOUS;
+	}
 
 	if (rt->polarity == POLARITY_INVERTED)
 		trigctrl |= TRIG_CTRL_INVERTED;
 
-	iowrite32(trigctrl, &dev->sync->triggerctrl);
+	trigctrl |= TRIG_CTRL_PXI_DELAY(rt->pxi_delay);
+
+	rt->regval = trigctrl;
+}
+
+static void triggerctrl_flush_terminal_attrs(struct route_terminal *rt)
+{
+	triggerctrl_update_regval(rt);
+	ni6674t_iowrite32(CTR_TRIG_WRITES, rt->regval,
+			  &rt->owner->sync->triggerctrl);
 }
 
 static void triggerctrl_set_input(struct route_terminal *rt,
@@ -96,12 +536,43 @@ static void triggerctrl_set_input(struct route_terminal *rt,
 	triggerctrl_flush_terminal_attrs(rt);
 }
 
+/* Re-clocking the sync clock with itself makes no sense; the hardware
+ *   only supports SyncClk as an asynchronous source. */
+static int validate_sync_mode(const struct route_terminal_input *input,
+			      enum terminal_sync_mode sync_mode)
+{
+	if (sync_mode == SYNC_MODE_SYNCHRONOUS && input->desc == &rt_sync_clk)
+		return -EINVAL;
+	return 0;
+}
+
 static ssize_t route_terminal_current_input_show(struct route_terminal *rt,
 					         char *buf)
 {
 	return snprintf(buf, PAGE_SIZE, "%s\n", rt->input->desc->name);
 }
 
+static int terminal_id(const struct route_terminal_desc *desc);
+
+/* Changes the terminal's input, and moves it to the new input's consumers */
+static void update_terminal_input(struct route_terminal *rt,
+				  const struct route_terminal_input *input)
+{
+	struct route_terminal_arena *arena = rt->owner->terminals;
+	int id;
+
+	id = terminal_id(rt->input->desc);
+	if (id >= 0 && id < arena->count)
+		clear_bit(rt->id, arena->rt[id].consumers);
+
+	rt->input = input;
+	ni6674t_count(CTR_ROUTE_COMMITS);
+
+	id = terminal_id(input->desc);
+	if (id >= 0 && id < arena->count)
+		set_bit(rt->id, arena->rt[id].consumers);
+}
+
 static void set_input_and_update_state(struct route_terminal *rt,
 				       const struct route_terminal_input *input)
 {
@@ -110,33 +581,148 @@ static void set_input_and_update_state(struct route_terminal *rt,
 	/* Update state regardless of whether there's a set_input function or
 	 * not.  This is to handle the case of terminals w/ hard-wired inputs
 	 * (terminal has an input, but nothing to program). */
-	rt->input = input;
+	update_terminal_input(rt, input);
 
 	if (desc->set_input)
 		desc->set_input(rt, input);
 }
 
+static const struct route_terminal_input *
+find_available_input(const struct route_terminal_desc *desc,
+		     const char *buf, size_t len)
+{
+	const struct route_terminal_input *in = desc->available_inputs;
+	const char *name;
+
+	while(in->desc) {
+		name = in->desc->name;
+		if(strlen(name) == len && !strncmp(buf, name, len))
+			return in;
+		in++;
+	}
+
+	return NULL;
+}
+
+static const struct route_terminal_input *
+find_input_desc(const struct route_terminal_desc *desc,
+		const struct route_terminal_desc *input)
+{
+	const struct route_terminal_input *in;
+
+	for (in = desc->available_inputs; in && in->desc; in++)
+		if (in->desc == input)
+			return in;
+	return NULL;
+}
+
+/* Room for the NI6674T_ROUTES variable of one batched uevent */
+#define ROUTE_EVENT_ROUTES_MAX	1536
+
+/* Reports a committed change to a single terminal's input or polarity as a
+ *   KOBJ_CHANGE uevent on the terminal. */
+static void notify_route_change(struct route_terminal *rt)
+{
+	struct ni6674t *dev = rt->owner;
+	char terminal[48], input[48], polarity[32], seq[40];
+	char *envp[] = { terminal, input, polarity, seq, NULL };
+
+	snprintf(terminal, sizeof(terminal), "NI6674T_TERMINAL=%s",
+		 rt->rt_desc->name);
+	snprintf(input, sizeof(input), "NI6674T_INPUT=%s",
+		 rt->input->desc->name);
+	snprintf(polarity, sizeof(polarity), "NI6674T_POLARITY=%s",
+		 terminal_polarity_strs[rt->polarity]);
+	snprintf(seq, sizeof(seq), "NI6674T_SEQ=%llu",
+		 (unsigned long long)atomic64_inc_return(&dev->route_seq));
+
+	kobject_uevent_env(&rt->kobj, KOBJ_CHANGE, envp);
+}
+
+/* Reports changes that were committed together as KOBJ_CHANGE uevents on
+ *   the PCI device, sharing a single sequence number.  The changes are
+ *   listed in NI6674T_ROUTES as Terminal:Input:polarity entries, split over
+ *   as few events as the uevent buffer allows. */
+static void notify_route_changes(struct ni6674t *dev,
+				 const struct route_assignment *changes, int n)
+{
+	char count[32], seq[40], *routes;
+	char *envp[] = { seq, count, NULL, NULL };
+	unsigned long long seqnum;
+	struct route_terminal *rt;
+	size_t len, entry;
+	int i = 0, first;
+
+	if (n <= 0)
+		return;
+
+	if (n == 1) {
+		notify_route_change(changes[0].rt);
+		return;
+	}
+
+	routes = kmalloc(ROUTE_EVENT_ROUTES_MAX, GFP_KERNEL);
+	if (!routes)
+		return;
+	envp[2] = routes;
+
+	seqnum = atomic64_inc_return(&dev->route_seq);
+	snprintf(seq, sizeof(seq), "NI6674T_SEQ=%llu", seqnum);
+
+	while (i < n) {
+		len = scnprintf(routes, ROUTE_EVENT_ROUTES_MAX, "NI6674T_ROUTES=");
+		for (first = i; i < n; i++) {
+			rt = changes[i].rt;
+			entry = strlen(rt->rt_desc->name) +
+				strlen(rt->input->desc->name) +
+				strlen(terminal_polarity_strs[rt->polarity]) + 3;
+			if (i > first && len + entry >= ROUTE_EVENT_ROUTES_MAX)
+				break;
+
+			len += scnprintf(routes + len,
+					 ROUTE_EVENT_ROUTES_MAX - len,
+					 "%s%s:%s:%s", i > first ? " " : "",
+					 rt->rt_desc->name,
+					 rt->input->desc->name,
+					 terminal_polarity_strs[rt->polarity]);
+		}
+		snprintf(count, sizeof(count), "NI6674T_COUNT=%d", i - first);
+
+		kobject_uevent_env(&dev->pdev->dev.kobj, KOBJ_CHANGE, envp);
+	}
+
+	kfree(routes);
+}
+
 static ssize_t route_terminal_current_input_store(struct route_terminal *rt,
 						  const char *buf, size_t count)
 {
-	const struct route_terminal_input *in = rt->rt_desc->available_inputs;
-	const char *name;
+	struct ni6674t *dev = rt->owner;
+	const struct route_terminal_input *in;
+	unsigned long flags;
+	ssize_t ret = count;
 	size_t len;
 
 	len = strlen(buf);
 	if (buf[len - 1] == '\n')
 		--len;
 
-	while(in->desc) {
-		name = in->desc->name;
-		if(!strncmp(buf, name, len)) {
-			set_input_and_update_state(rt, in);
-			return count;
-		}
-		in++;
-	}
-
-	return -EINVAL;
+	in = find_available_input(rt->rt_desc, buf, len);
+	if (!in)
+		return -EINVAL;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (validate_sync_mode(in, rt->sync_mode))
+		ret = -EINVAL;
+	else if (terminal_busy(rt) || reserved_by_other_process(rt))
+		ret = -EBUSY;
+	else
+		set_input_and_update_state(rt, in);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	if (ret == count)
+		notify_route_change(rt);
+	return ret;
 }
 
 static ssize_t route_terminal_polarity_show(struct route_terminal *rt,
@@ -149,20 +735,136 @@ static ssize_t route_terminal_polarity_show(struct route_terminal *rt,
 static ssize_t route_terminal_polarity_store(struct route_terminal *rt,
 					     const char *buf, size_t count)
 {
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
 	int i;
 
 	for (i = 0; i < ARRAY_SIZE(terminal_polarity_strs); i++) {
 		const char *name = terminal_polarity_strs[i];
-		if (!strncmp(name, buf, strlen(name))) {
-			rt->polarity = i;
-			triggerctrl_flush_terminal_attrs(rt);
-			return count;
-		}
+		if (!strncmp(name, buf, strlen(name)))
+			break;
+	}
+	if (i == ARRAY_SIZE(terminal_polarity_strs))
+		return -EINVAL;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (terminal_busy(rt) || reserved_by_other_process(rt)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		return -EBUSY;
 	}
+	set_terminal_polarity(rt, i);
+	triggerctrl_flush_terminal_attrs(rt);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	notify_route_change(rt);
+	return count;
+}
+
+static int match_terminal_attr_str(const char *strs[], size_t nstrs,
+				   const char *buf)
+{
+	int i;
+
+	for (i = 0; i < nstrs; i++)
+		if (!strncmp(strs[i], buf, strlen(strs[i])))
+			return i;
 
 	return -EINVAL;
 }
 
+static ssize_t route_terminal_sync_mode_show(struct route_terminal *rt,
+					     char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%s\n",
+			terminal_sync_mode_strs[rt->sync_mode]);
+}
+
+static ssize_t route_terminal_sync_mode_store(struct route_terminal *rt,
+					      const char *buf, size_t count)
+{
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
+	ssize_t ret = count;
+	int mode;
+
+	mode = match_terminal_attr_str(terminal_sync_mode_strs,
+				       ARRAY_SIZE(terminal_sync_mode_strs), buf);
+	if (mode < 0)
+		return mode;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (validate_sync_mode(rt->input, mode)) {
+		ret = -EINVAL;
+	} else if (terminal_busy(rt) || reserved_by_other_process(rt)) {
+		ret = -EBUSY;
+	} else {
+		rt->sync_mode = mode;
+		triggerctrl_flush_terminal_attrs(rt);
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	return ret;
+}
+
+static ssize_t route_terminal_sync_clock_show(struct route_terminal *rt,
+					      char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%s\n",
+			terminal_sync_clock_strs[rt->sync_clock]);
+}
+
+static ssize_t route_terminal_sync_clock_store(struct route_terminal *rt,
+					       const char *buf, size_t count)
+{
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
+	int clock;
+
+	clock = match_terminal_attr_str(terminal_sync_clock_strs,
+					ARRAY_SIZE(terminal_sync_clock_strs), buf);
+	if (clock < 0)
+		return clock;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (terminal_busy(rt) || reserved_by_other_process(rt)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		return -EBUSY;
+	}
+	rt->sync_clock = clock;
+	triggerctrl_flush_terminal_attrs(rt);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	return count;
+}
+
+static ssize_t route_terminal_sync_edge_show(struct route_terminal *rt,
+					     char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%s\n",
+			terminal_sync_edge_strs[rt->sync_edge]);
+}
+
+static ssize_t route_terminal_sync_edge_store(struct route_terminal *rt,
+					      const char *buf, size_t count)
+{
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
+	int edge;
+
+	edge = match_terminal_attr_str(terminal_sync_edge_strs,
+				       ARRAY_SIZE(terminal_sync_edge_strs), buf);
+	if (edge < 0)
+		return edge;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (terminal_busy(rt) || reserved_by_other_process(rt)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		return -EBUSY;
+	}
+	rt->sync_edge = edge;
+	triggerctrl_flush_terminal_attrs(rt);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	return count;
+}
+
 static ssize_t route_terminal_available_inputs_show(struct route_terminal *rt,
 						  char *buf)
 {
@@ -183,78 +885,869 @@ static ssize_t route_terminal_available_inputs_show(struct route_terminal *rt,
 	return total;
 }
 
-static ssize_t route_terminal_line_state_show(struct route_terminal *rt,
-					      char *buf)
+static int read_line_state(struct route_terminal *rt)
 {
 	struct ni6674t *dev = rt->owner;
-	const struct route_terminal_desc* rt_desc = rt->rt_desc;
+	unsigned int lsb = rt->rt_desc->line_state_bit;
 	u32 trigread;
-	unsigned int lsb;
-	unsigned long line_state;
 
-	lsb = rt_desc->line_state_bit;
-	trigread = ioread32(&dev->sync->trigread[lsb / 32]);
-	line_state = !!(trigread & (1 << (lsb % 32)));
+	if (lsb == NO_LINE_STATE_BIT)
+		return -ENODEV;
 
-	return snprintf(buf, PAGE_SIZE, "%lu\n", line_state);
+	trigread = ni6674t_ioread32(CTR_TRIG_READS,
+				    &dev->sync->trigread[lsb / 32]);
+	return !!(trigread & (1 << (lsb % 32)));
 }
 
-static ROUTE_TERMINAL_ATTR(current_input, 0600);
-static ROUTE_TERMINAL_ATTR(polarity, 0600);
-static ROUTE_TERMINAL_ATTR_RO(available_inputs, 0600);
-static ROUTE_TERMINAL_ATTR_RO(line_state, 0600);
+/* Bound on how long a software pulse waits to see its level on the line */
+#define PULSE_READBACK_LIMIT	1000
 
-static const struct route_terminal_desc pfi_rt_desc[];
+/* Drives a single pulse onto a triggerctrl terminal by switching its
+ *   source to logic_high and back, then restores the routed input.  The
+ *   pulse is kept asynchronous regardless of the terminal's sync_mode so it
+ *   reaches the line as quickly as possible.  Called with rt claimed
+ *   through busy, which is given back once the route is restored. */
+static void pulse_terminal(struct route_terminal *rt,
+			   struct ni6674t_fire *fire)
+{
+	struct ni6674t *dev = rt->owner;
+	unsigned int timeout = PULSE_READBACK_LIMIT;
+	unsigned long flags;
+	int asserted, state;
+	ktime_t start;
+	u32 trigctrl;
 
-#define PXI_TRIG_RT_DESC_MEMBERS(n)					\
-	.name		= "PXI_Trig" #n,				\
-	.dest_data	= TRIG_CTRL_DEST_PXITRIG(n),			\
-	.line_state_bit	= TRIG_READ_PXI_TRIG_LINE_STATE_BIT(n),		\
-	.set_input	= &triggerctrl_set_input
+	trigctrl = TRIG_CTRL_DEST(rt->rt_desc->dest_data) |
+		   TRIG_CTRL_ENABLED | TRIG_CTRL_ASYNCHRONOUS |
+		   TRIG_CTRL_PXI_DELAY(rt->pxi_delay);
+	if (rt->polarity == POLARITY_INVERTED)
+		trigctrl |= TRIG_CTRL_INVERTED;
+	asserted = rt->polarity == POLARITY_NORMAL;
 
-#define PFI_SE_INPUT(n) { &pfi_rt_desc[n], TRIG_CTRL_SRC_PFI_SE(n) }
-#define ALL_PFI_SE_INPUTS	\
-	PFI_SE_INPUT(0),	\
-	PFI_SE_INPUT(1),	\
-	PFI_SE_INPUT(2),	\
-	PFI_SE_INPUT(3),	\
-	PFI_SE_INPUT(4),	\
-	PFI_SE_INPUT(5)
+	fire->flags = 0;
 
-static const struct route_terminal_desc pxi_trig_rt_desc[] = {
-	{
-		PXI_TRIG_RT_DESC_MEMBERS(0),
-		.available_inputs = (const struct route_terminal_input[])
-			{
-				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
-				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
-				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
-				ALL_PFI_SE_INPUTS,
-				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
-				{ &pxi_trig_rt_desc[2], TRIG_CTRL_SRC_PXITRIG(2) },
-				{ &pxi_trig_rt_desc[3], TRIG_CTRL_SRC_PXITRIG(3) },
-				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
-				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
-				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
-				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
-				{ NULL, 0 },
-			},
-	},
-	{
-		PXI_TRIG_RT_DESC_MEMBERS(1),
-		.available_inputs = (const struct route_terminal_input[])
-			{
-				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
-				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
-				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
-				ALL_PFI_SE_INPUTS,
-				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
-				{ &pxi_trig_rt_desc[2], TRIG_CTRL_SRC_PXITRIG(2) },
-				{ &pxi_trig_rt_desc[3], TRIG_CTRL_SRC_PXITRIG(3) },
-				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
+	preempt_disable();
+	start = ktime_get();
+	ni6674t_iowrite32(CTR_TRIG_WRITES,
+			  trigctrl | TRIG_CTRL_SRC(TRIG_CTRL_SRC_LOGIC_HIGH),
+			  &dev->sync->triggerctrl);
+
+	do {
+		state = read_line_state(rt);
+	} while (state >= 0 && state != asserted && --timeout);
+
+	/* No readback; at least make sure the write has left the host */
+	if (state < 0)
+		ni6674t_ioread32(CTR_TRIG_READS, &dev->sync->trigread[0]);
+
+	fire->latency_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (state == asserted)
+		fire->flags |= NI6674T_FIRE_OBSERVED;
+
+	ni6674t_iowrite32(CTR_TRIG_WRITES,
+			  trigctrl | TRIG_CTRL_SRC(TRIG_CTRL_SRC_LOGIC_LOW),
+			  &dev->sync->triggerctrl);
+	spin_lock_irqsave(&dev->route_lock, flags);
+	triggerctrl_flush_terminal_attrs(rt);
+	rt->busy = false;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	preempt_enable();
+}
+
+static ssize_t route_terminal_line_state_show(struct route_terminal *rt,
+					      char *buf)
+{
+	int line_state;
+
+	line_state = read_line_state(rt);
+	if (line_state < 0)
+		return line_state;
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", line_state);
+}
+
+/* Pulse trains faster than this would keep the CPU in the timer */
+#define GENERATOR_MIN_PERIOD_NS		10000
+/* Lead time given to generator_start so every armed train starts together */
+#define GENERATOR_START_LEAD_NS		100000
+
+static const char *pulse_generator_state_strs[] = {
+	[GENERATOR_IDLE]	= "idle",
+	[GENERATOR_ARMED]	= "armed",
+	[GENERATOR_RUNNING]	= "running",
+	[GENERATOR_DONE]	= "done",
+};
+
+static const char *pulse_generator_start_strs[] = {
+	[GENERATOR_START_NOW]	= "now",
+	[GENERATOR_START_SYNC]	= "sync",
+};
+
+static enum hrtimer_restart pulse_generator_timer(struct hrtimer *timer)
+{
+	struct pulse_generator *gen = container_of(timer,
+						   struct pulse_generator,
+						   timer);
+	struct ni6674t *dev = gen->rt->owner;
+	ktime_t now, expires = hrtimer_get_expires(timer);
+	unsigned long flags;
+	s64 late;
+
+	if (!gen->high) {
+		ni6674t_iowrite32(CTR_TRIG_WRITES, gen->word_high,
+				  &dev->sync->triggerctrl);
+		now = ktime_get();
+		gen->high = true;
+		if (!gen->pulses++)
+			gen->first_rise = now;
+		gen->last_rise = now;
+		hrtimer_set_expires(timer, ktime_add_ns(expires, gen->high_ns));
+	} else {
+		ni6674t_iowrite32(CTR_TRIG_WRITES, gen->word_low,
+				  &dev->sync->triggerctrl);
+		now = ktime_get();
+		gen->high = false;
+		hrtimer_set_expires(timer, ktime_add_ns(expires,
+					gen->period_ns - gen->high_ns));
+	}
+
+	late = ktime_to_ns(ktime_sub(now, expires));
+	if (late > 0) {
+		gen->late_sum_ns += late;
+		if (late > gen->late_max_ns)
+			gen->late_max_ns = late;
+	}
+	gen->edges++;
+
+	if (!gen->high && gen->count && gen->pulses == gen->count) {
+		spin_lock_irqsave(&dev->route_lock, flags);
+		gen->state = GENERATOR_DONE;
+		triggerctrl_flush_terminal_attrs(gen->rt);
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		return HRTIMER_NORESTART;
+	}
+
+	return HRTIMER_RESTART;
+}
+
+/* Starts an armed pulse train with its first rising edge at start.
+ *   Called with route_lock held. */
+static void pulse_generator_start(struct pulse_generator *gen, ktime_t start)
+{
+	gen->state = GENERATOR_RUNNING;
+	hrtimer_start(&gen->timer, start, HRTIMER_MODE_ABS);
+}
+
+/* Stops a pulse train and gives the terminal back its routed input */
+static void pulse_generator_stop(struct route_terminal *rt)
+{
+	struct pulse_generator *gen = rt->generator;
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
+
+	if (!gen)
+		return;
+
+	/* Outside route_lock, which the timer takes when the train ends */
+	hrtimer_cancel(&gen->timer);
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	/* An armed train already drives the line low */
+	if (gen->state == GENERATOR_RUNNING || gen->state == GENERATOR_ARMED)
+		triggerctrl_flush_terminal_attrs(rt);
+	if (gen->state != GENERATOR_DONE)
+		gen->state = GENERATOR_IDLE;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+}
+
+static ssize_t route_terminal_generator_show(struct route_terminal *rt,
+					     char *buf)
+{
+	struct ni6674t *dev = rt->owner;
+	struct pulse_generator *gen;
+	u64 mhz = 0, hz, elapsed;
+	u32 frac;
+	ssize_t total;
+
+	mutex_lock(&dev->devlock);
+	gen = rt->generator;
+	if (!gen) {
+		mutex_unlock(&dev->devlock);
+		return snprintf(buf, PAGE_SIZE, "state %s\n",
+				pulse_generator_state_strs[GENERATOR_IDLE]);
+	}
+
+	/* Achieved frequency in millihertz, from the rising edges */
+	elapsed = ktime_to_us(ktime_sub(gen->last_rise, gen->first_rise));
+	if (gen->pulses > 1 && elapsed)
+		mhz = div64_u64((u64) (gen->pulses - 1) * NSEC_PER_SEC, elapsed);
+	hz = div_u64_rem(mhz, 1000, &frac);
+
+	total = snprintf(buf, PAGE_SIZE,
+			 "state %s\nperiod_ns %llu\nduty %u\ncount %u\n"
+			 "start %s\npulses %u\nachieved_hz %llu.%03u\n"
+			 "late_mean_ns %llu\nlate_max_ns %llu\n",
+			 pulse_generator_state_strs[gen->state],
+			 (unsigned long long) gen->period_ns,
+			 (unsigned int) div64_u64(gen->high_ns * 100,
+						  gen->period_ns),
+			 gen->count, pulse_generator_start_strs[gen->start],
+			 gen->pulses,
+			 (unsigned long long) hz, frac,
+			 (unsigned long long) (gen->edges ?
+				div_u64(gen->late_sum_ns, gen->edges) : 0),
+			 (unsigned long long) gen->late_max_ns);
+	mutex_unlock(&dev->devlock);
+
+	return total;
+}
+
+/* Configures and starts a pulse train, given as space-separated
+ *   period_ns=, duty=, count= and start= settings, or stops it. */
+static ssize_t route_terminal_generator_store(struct route_terminal *rt,
+					      const char *buf, size_t count)
+{
+	struct ni6674t *dev = rt->owner;
+	struct pulse_generator *gen;
+	unsigned int duty = 50, pulses = 0;
+	int start = GENERATOR_START_NOW;
+	u64 period_ns = 0;
+	char *copy, *cur, *tok, *val;
+	unsigned long flags;
+	bool reserved;
+	u32 trigctrl;
+	int err = 0;
+
+	if (sysfs_streq(buf, "stop")) {
+		mutex_lock(&dev->devlock);
+		spin_lock_irqsave(&dev->route_lock, flags);
+		reserved = reserved_by_other_process(rt);
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		if (!reserved)
+			pulse_generator_stop(rt);
+		mutex_unlock(&dev->devlock);
+		return reserved ? -EBUSY : count;
+	}
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	cur = strim(copy);
+	while (!err && (tok = strsep(&cur, " \t\n"))) {
+		if (!*tok)
+			continue;
+
+		val = strchr(tok, '=');
+		if (!val) {
+			err = -EINVAL;
+			break;
+		}
+		*val++ = '\0';
+
+		if (!strcmp(tok, "period_ns"))
+			err = kstrtoull(val, 0, &period_ns);
+		else if (!strcmp(tok, "duty"))
+			err = kstrtouint(val, 0, &duty);
+		else if (!strcmp(tok, "count"))
+			err = kstrtouint(val, 0, &pulses);
+		else if (!strcmp(tok, "start")) {
+			start = match_terminal_attr_str(pulse_generator_start_strs,
+					ARRAY_SIZE(pulse_generator_start_strs),
+					val);
+			if (start < 0)
+				err = start;
+		} else {
+			err = -EINVAL;
+		}
+	}
+	kfree(copy);
+
+	if (err)
+		return err;
+
+	if (period_ns < GENERATOR_MIN_PERIOD_NS || !duty || duty >= 100)
+		return -EINVAL;
+
+	mutex_lock(&dev->devlock);
+	if (!rt->generator) {
+		rt->generator = kzalloc(sizeof(*rt->generator), GFP_KERNEL);
+		if (!rt->generator) {
+			err = -ENOMEM;
+			goto out;
+		}
+		hrtimer_init(&rt->generator->timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS);
+		rt->generator->timer.function = pulse_generator_timer;
+		rt->generator->rt = rt;
+	}
+
+	gen = rt->generator;
+	pulse_generator_stop(rt);
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (rt->busy || reserved_by_other_process(rt)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		err = -EBUSY;
+		goto out;
+	}
+
+	/* The train is asynchronous, like a fired pulse, and honors polarity */
+	trigctrl = TRIG_CTRL_DEST(rt->rt_desc->dest_data) |
+		   TRIG_CTRL_ENABLED | TRIG_CTRL_ASYNCHRONOUS |
+		   TRIG_CTRL_PXI_DELAY(rt->pxi_delay);
+	if (rt->polarity == POLARITY_INVERTED)
+		trigctrl |= TRIG_CTRL_INVERTED;
+
+	gen->word_high = trigctrl | TRIG_CTRL_SRC(TRIG_CTRL_SRC_LOGIC_HIGH);
+	gen->word_low = trigctrl | TRIG_CTRL_SRC(TRIG_CTRL_SRC_LOGIC_LOW);
+	gen->period_ns = period_ns;
+	gen->high_ns = div_u64(period_ns * duty, 100);
+	gen->count = pulses;
+	gen->start = start;
+	gen->high = false;
+	gen->pulses = 0;
+	gen->edges = 0;
+	gen->late_sum_ns = 0;
+	gen->late_max_ns = 0;
+
+	ni6674t_iowrite32(CTR_TRIG_WRITES, gen->word_low,
+			  &dev->sync->triggerctrl);
+	if (start == GENERATOR_START_NOW)
+		pulse_generator_start(gen, ktime_get());
+	else
+		gen->state = GENERATOR_ARMED;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+out:
+	mutex_unlock(&dev->devlock);
+	return err ? err : count;
+}
+
+/* Matches a terminal name against a pattern where '*' stands for any run
+ *   of characters and '?' for any one character */
+static bool terminal_name_match(const char *pat, const char *name)
+{
+	const char *star = NULL, *resume = NULL;
+
+	while (*name) {
+		if (*pat == '*') {
+			star = pat++;
+			resume = name;
+		} else if (*pat == '?' || *pat == *name) {
+			pat++;
+			name++;
+		} else if (star) {
+			pat = star + 1;
+			name = ++resume;
+		} else {
+			return false;
+		}
+	}
+
+	while (*pat == '*')
+		pat++;
+	return !*pat;
+}
+
+static bool fanout_has_dest(const struct route_assignment *changes, int n,
+			    const struct route_terminal *dst)
+{
+	while (n--)
+		if (changes[n].rt == dst)
+			return true;
+	return false;
+}
+
+static ssize_t route_terminal_fanout_show(struct route_terminal *rt,
+					  char *buf)
+{
+	struct route_terminal_arena *arena = rt->owner->terminals;
+	struct route_terminal *dst;
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < arena->count; i++) {
+		dst = &arena->rt[i];
+		if (dst->input->desc == rt->rt_desc)
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   "%s%s", total ? " " : "",
+					   dst->rt_desc->name);
+	}
+
+	return total + scnprintf(buf + total, PAGE_SIZE - total, "\n");
+}
+
+/*
+ * Routes this terminal to every destination in a list of names and
+ * patterns, such as "PXI_Star*".  Names must be able to take this
+ * terminal as an input; patterns select only the terminals that can.
+ * Every destination is checked first, and the triggerctrl words are then
+ * written back to back under route_lock, with interrupts off, so the
+ * destinations switch over as close together as the bus allows.
+ */
+static ssize_t route_terminal_fanout_store(struct route_terminal *rt,
+					   const char *buf, size_t count)
+{
+	struct route_terminal_arena *arena = rt->owner->terminals;
+	struct ni6674t *dev = rt->owner;
+	const struct route_terminal_input *in;
+	struct route_assignment *changes;
+	struct route_terminal *dst;
+	char *copy, *cur, *tok;
+	unsigned long flags;
+	bool pattern, found;
+	int i, n = 0, err = 0;
+
+	changes = kcalloc(arena->count, sizeof(*changes), GFP_KERNEL);
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!changes || !copy) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while (!err && (tok = strsep(&cur, " ,\t\n"))) {
+		if (!*tok)
+			continue;
+
+		pattern = strpbrk(tok, "*?") != NULL;
+		found = false;
+		for (i = 0; i < arena->count; i++) {
+			dst = &arena->rt[i];
+			if (!terminal_name_match(tok, dst->rt_desc->name))
+				continue;
+
+			in = find_input_desc(dst->rt_desc, rt->rt_desc);
+			if (dst->rt_desc->set_input != &triggerctrl_set_input ||
+			    !in || validate_sync_mode(in, dst->sync_mode)) {
+				if (pattern)
+					continue;
+				err = -EINVAL;
+				break;
+			}
+
+			found = true;
+			if (!fanout_has_dest(changes, n, dst)) {
+				changes[n].rt = dst;
+				changes[n++].input = in;
+			}
+		}
+
+		if (!err && !found)
+			err = -EINVAL;
+	}
+
+	if (err || !n)
+		goto out;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n; i++) {
+		dst = changes[i].rt;
+		if (validate_sync_mode(changes[i].input, dst->sync_mode)) {
+			err = -EINVAL;
+			break;
+		}
+		if (terminal_busy(dst) || reserved_by_other_process(dst)) {
+			err = -EBUSY;
+			break;
+		}
+	}
+	if (err) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		update_terminal_input(changes[i].rt, changes[i].input);
+		triggerctrl_update_regval(changes[i].rt);
+	}
+
+	for (i = 0; i < n; i++)
+		ni6674t_iowrite32(CTR_TRIG_WRITES, changes[i].rt->regval,
+				  &dev->sync->triggerctrl);
+	ni6674t_ioread32(CTR_TRIG_READS, &dev->sync->triggerctrl);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	notify_route_changes(dev, changes, n);
+out:
+	kfree(copy);
+	kfree(changes);
+	return err ? err : count;
+}
+
+static ssize_t route_terminal_consumers_show(struct route_terminal *rt,
+					     char *buf)
+{
+	struct route_terminal_arena *arena = rt->owner->terminals;
+	size_t total = 0;
+	int i;
+
+	for_each_set_bit(i, rt->consumers, arena->count)
+		total += scnprintf(buf + total, PAGE_SIZE - total, "%s%s",
+				   total ? " " : "",
+				   arena->rt[i].rt_desc->name);
+
+	return total + scnprintf(buf + total, PAGE_SIZE - total, "\n");
+}
+
+/*
+ * Adds up the nominal latency and jitter of every terminal from rt back
+ * along the programmed inputs to where the signal enters the board: an
+ * input without a directory, such as ClkIn or PXIe_DStarC0, or a terminal
+ * that is floating and so driven from outside.  A synchronous terminal
+ * adds a period of its sync clock to the jitter, and one and a half to
+ * the latency, for the wait for the clock edge plus the register.  Inputs
+ * are read without locking, so a chain being changed may mix old and new
+ * routes.
+ */
+static int route_latency(struct route_terminal *rt, unsigned int *latency_ns,
+			 unsigned int *jitter_ns,
+			 const struct route_terminal_desc **origin)
+{
+	struct route_terminal_arena *arena = rt->owner->terminals;
+	const struct route_terminal_desc *src;
+	unsigned int period, hops = 0;
+	int id;
+
+	*latency_ns = 0;
+	*jitter_ns = 0;
+
+	/* Not driven by the board at all */
+	if (ACCESS_ONCE(rt->input)->desc == &rt_floating)
+		return -ENODATA;
+
+	for (;;) {
+		/* Terminals routed in a loop never reach an origin */
+		if (++hops > arena->count)
+			return -ELOOP;
+
+		*latency_ns += rt->rt_desc->latency_ns;
+		*jitter_ns += rt->rt_desc->jitter_ns;
+		if (rt->rt_desc->set_input == &triggerctrl_set_input &&
+		    rt->sync_mode == SYNC_MODE_SYNCHRONOUS) {
+			period = terminal_sync_clock_period_ns[rt->sync_clock];
+			*latency_ns += period + period / 2;
+			*jitter_ns += period;
+		}
+
+		src = ACCESS_ONCE(rt->input)->desc;
+		id = terminal_id(src);
+		if (id < 0 || id >= arena->count)
+			break;
+
+		rt = &arena->rt[id];
+		if (ACCESS_ONCE(rt->input)->desc == &rt_floating)
+			break;
+	}
+
+	*origin = src;
+	return 0;
+}
+
+static ssize_t route_terminal_latency_ns_show(struct route_terminal *rt,
+					      char *buf)
+{
+	const struct route_terminal_desc *origin;
+	unsigned int latency_ns, jitter_ns;
+	int err;
+
+	err = route_latency(rt, &latency_ns, &jitter_ns, &origin);
+	if (err == -ENODATA)
+		return snprintf(buf, PAGE_SIZE, "none\n");
+	if (err == -ELOOP)
+		return snprintf(buf, PAGE_SIZE, "loop\n");
+
+	return snprintf(buf, PAGE_SIZE, "%u %u %s\n", latency_ns, jitter_ns,
+			origin->name);
+}
+
+static bool is_dstara_fabric_terminal(const struct route_terminal_desc *desc);
+static void dstara_fold_route(u32 *ctrl1, u32 *ctrl2,
+			      const struct route_terminal_desc *desc,
+			      const struct route_terminal_input *input);
+
+/*
+ * Disconnects every consumer of this terminal, setting it to 'floating',
+ * or to its default input if it can't float.  A consumer whose default
+ * input is this very terminal has nowhere to go and is left alone, so it
+ * is neither rewritten nor announced.  The new routes are applied
+ * in one pass under route_lock: the triggerctrl words back to back, and
+ * the DStarA fabric with a single write of each control register.
+ */
+static ssize_t route_terminal_unroute_store(struct route_terminal *rt,
+					    const char *buf, size_t count)
+{
+	struct route_terminal_arena *arena = rt->owner->terminals;
+	struct ni6674t *dev = rt->owner;
+	const struct route_terminal_input *in;
+	struct route_assignment *changes;
+	struct route_terminal *dst;
+	bool fabric = false;
+	unsigned long flags;
+	u32 ctrl1, ctrl2;
+	int i, n = 0, err = 0;
+
+	changes = kcalloc(arena->count, sizeof(*changes), GFP_KERNEL);
+	if (!changes)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for_each_set_bit(i, rt->consumers, arena->count) {
+		dst = &arena->rt[i];
+		in = find_input_desc(dst->rt_desc, &rt_floating);
+		if (!in)
+			in = &dst->rt_desc->available_inputs[0];
+		/* Its default input is this terminal: nothing to fall back to */
+		if (in->desc == rt->rt_desc)
+			continue;
+
+		if (terminal_busy(dst) || reserved_by_other_process(dst)) {
+			err = -EBUSY;
+			goto out_unlock;
+		}
+
+		changes[n].rt = dst;
+		changes[n++].input = in;
+	}
+
+	ctrl1 = dev->dstaractrl1;
+	ctrl2 = dev->dstaractrl2;
+	for (i = 0; i < n; i++) {
+		dst = changes[i].rt;
+		update_terminal_input(dst, changes[i].input);
+		if (dst->rt_desc->set_input == &triggerctrl_set_input) {
+			triggerctrl_update_regval(dst);
+		} else if (is_dstara_fabric_terminal(dst->rt_desc)) {
+			dstara_fold_route(&ctrl1, &ctrl2, dst->rt_desc,
+					  changes[i].input);
+			fabric = true;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		if (changes[i].rt->rt_desc->set_input == &triggerctrl_set_input)
+			ni6674t_iowrite32(CTR_TRIG_WRITES,
+					  changes[i].rt->regval,
+					  &dev->sync->triggerctrl);
+	if (fabric) {
+		dev->dstaractrl2 = ctrl2;
+		ni6674t_iowrite32(CTR_DSTARA_WRITES, ctrl2,
+				  &dev->sync->dstaractrl2);
+		dev->dstaractrl1 = ctrl1;
+		ni6674t_iowrite32(CTR_DSTARA_WRITES, ctrl1,
+				  &dev->sync->dstaractrl1);
+	}
+	mmiowb();
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	notify_route_changes(dev, changes, n);
+	kfree(changes);
+	return count;
+
+out_unlock:
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	kfree(changes);
+	return err;
+}
+
+static ssize_t route_terminal_pxi_delay_show(struct route_terminal *rt,
+					     char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", rt->pxi_delay);
+}
+
+static ssize_t route_terminal_pxi_delay_store(struct route_terminal *rt,
+					      const char *buf, size_t count)
+{
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
+	unsigned int delay;
+	int err;
+
+	err = kstrtouint(buf, 0, &delay);
+	if (err)
+		return err;
+
+	if (delay > TRIG_CTRL_PXI_DELAY_MAX)
+		return -EINVAL;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (terminal_busy(rt) || reserved_by_other_process(rt)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		return -EBUSY;
+	}
+	rt->pxi_delay = delay;
+	triggerctrl_flush_terminal_attrs(rt);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	return count;
+}
+
+static ROUTE_TERMINAL_ATTR(current_input, 0600);
+static ROUTE_TERMINAL_ATTR(polarity, 0600);
+static ROUTE_TERMINAL_ATTR_RO(available_inputs, 0600);
+static ROUTE_TERMINAL_ATTR_RO(line_state, 0600);
+static ROUTE_TERMINAL_ATTR(sync_mode, 0600);
+static ROUTE_TERMINAL_ATTR(sync_clock, 0600);
+static ROUTE_TERMINAL_ATTR(sync_edge, 0600);
+static ROUTE_TERMINAL_ATTR(generator, 0600);
+static ROUTE_TERMINAL_ATTR(fanout, 0600);
+static ROUTE_TERMINAL_ATTR_RO(consumers, 0600);
+static ROUTE_TERMINAL_ATTR_RO(latency_ns, 0600);
+static ROUTE_TERMINAL_ATTR_WO(unroute, 0200);
+static ROUTE_TERMINAL_ATTR(pxi_delay, 0600);
+
+static const struct route_terminal_desc pfi_rt_desc[];
+static const struct route_terminal_desc lvds_rt_desc[];
+static const struct route_terminal_desc pxi_star_periph_rt_desc;
+
+/*
+ * Nominal propagation delay and peak-to-peak jitter of each kind of
+ * terminal, in nanoseconds, from its input through the crosspoint to its
+ * line.  They are planning estimates, not calibrated figures; the delays
+ * that pxi_delay adds are not included.
+ */
+#define PXI_TRIG_LATENCY_NS	12	/* bused, open collector */
+#define PXI_TRIG_JITTER_NS	2
+#define PFI_LATENCY_NS		8
+#define PFI_JITTER_NS		1
+#define PXI_STAR_LATENCY_NS	5
+#define PXI_STAR_JITTER_NS	1
+#define LVDS_LATENCY_NS		4	/* PXIe_DStarB, LVDS and the
+					 * PXIe_DStarC peripheral line */
+#define LVDS_JITTER_NS		1
+#define DSTARA_MUX_LATENCY_NS	2	/* SourceA/B, divider selects, banks */
+#define DSTARA_MUX_JITTER_NS	0
+#define DSTARA_DIV_LATENCY_NS	4
+#define DSTARA_DIV_JITTER_NS	1
+#define DSTARA_LATENCY_NS	3
+#define DSTARA_JITTER_NS	1
+
+#define PXIE_DSTARC_RT_DESC_MEMBERS(n)					\
+	.name		= "PXIe_DStarC" #n
+
+/* The PXIe_DStarC lines are driven by the peripheral slots, and the
+ *   PXIe_DStarB peripheral line is driven by the system timing slot.  They
+ *   are only ever inputs to this board, so they have no kobjects. */
+static const struct route_terminal_desc pxie_dstarc_rt_desc[] = {
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(0) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(1) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(2) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(3) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(4) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(5) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(6) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(7) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(8) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(9) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(10) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(11) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(12) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(13) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(14) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(15) },
+	{ PXIE_DSTARC_RT_DESC_MEMBERS(16) },
+};
+
+static const struct route_terminal_desc pxie_dstarb_periph_rt_desc = {
+	.name		= "PXIe_DStarBPeriph",
+};
+
+#define LVDS_INPUT(n) { &lvds_rt_desc[n], TRIG_CTRL_SRC_LVDS(n) }
+#define ALL_LVDS_INPUTS		\
+	LVDS_INPUT(0),		\
+	LVDS_INPUT(1),		\
+	LVDS_INPUT(2)
+
+#define PXIE_DSTARC_INPUT(n) { &pxie_dstarc_rt_desc[n], TRIG_CTRL_SRC_PXIeDSTARC(n) }
+#define ALL_PXIE_DSTARC_INPUTS	\
+	PXIE_DSTARC_INPUT(0),	\
+	PXIE_DSTARC_INPUT(1),	\
+	PXIE_DSTARC_INPUT(2),	\
+	PXIE_DSTARC_INPUT(3),	\
+	PXIE_DSTARC_INPUT(4),	\
+	PXIE_DSTARC_INPUT(5),	\
+	PXIE_DSTARC_INPUT(6),	\
+	PXIE_DSTARC_INPUT(7),	\
+	PXIE_DSTARC_INPUT(8),	\
+	PXIE_DSTARC_INPUT(9),	\
+	PXIE_DSTARC_INPUT(10),	\
+	PXIE_DSTARC_INPUT(11),	\
+	PXIE_DSTARC_INPUT(12),	\
+	PXIE_DSTARC_INPUT(13),	\
+	PXIE_DSTARC_INPUT(14),	\
+	PXIE_DSTARC_INPUT(15),	\
+	PXIE_DSTARC_INPUT(16)
+
+#define PXI_STAR_PERIPH_INPUT	\
+	{ &pxi_star_periph_rt_desc, TRIG_CTRL_SRC_STAR_PERIPH }
+#define PXIE_DSTARB_PERIPH_INPUT	\
+	{ &pxie_dstarb_periph_rt_desc, TRIG_CTRL_SRC_DSTARB_PERIPH }
+
+#define PXI_TRIG_RT_DESC_MEMBERS(n)					\
+	.name		= "PXI_Trig" #n,				\
+	.dest_data	= TRIG_CTRL_DEST_PXITRIG(n),			\
+	.line_state_bit	= TRIG_READ_PXI_TRIG_LINE_STATE_BIT(n),		\
+	.latency_ns	= PXI_TRIG_LATENCY_NS,				\
+	.jitter_ns	= PXI_TRIG_JITTER_NS,				\
+	.set_input	= &triggerctrl_set_input
+
+#define PFI_SE_INPUT(n) { &pfi_rt_desc[n], TRIG_CTRL_SRC_PFI_SE(n) }
+#define ALL_PFI_SE_INPUTS	\
+	PFI_SE_INPUT(0),	\
+	PFI_SE_INPUT(1),	\
+	PFI_SE_INPUT(2),	\
+	PFI_SE_INPUT(3),	\
+	PFI_SE_INPUT(4),	\
+	PFI_SE_INPUT(5)
+
+static const struct route_terminal_desc pxi_trig_rt_desc[] = {
+	{
+		PXI_TRIG_RT_DESC_MEMBERS(0),
+		.available_inputs = (const struct route_terminal_input[])
+			{
+				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+				ALL_PFI_SE_INPUTS,
+				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
+				{ &pxi_trig_rt_desc[2], TRIG_CTRL_SRC_PXITRIG(2) },
+				{ &pxi_trig_rt_desc[3], TRIG_CTRL_SRC_PXITRIG(3) },
+				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
+				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
+				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
+				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
+				{ NULL, 0 },
+			},
+	},
+	{
+		PXI_TRIG_RT_DESC_MEMBERS(1),
+		.available_inputs = (const struct route_terminal_input[])
+			{
+				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+				ALL_PFI_SE_INPUTS,
+				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
+				{ &pxi_trig_rt_desc[2], TRIG_CTRL_SRC_PXITRIG(2) },
+				{ &pxi_trig_rt_desc[3], TRIG_CTRL_SRC_PXITRIG(3) },
+				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
 				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
 				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
 				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -265,6 +1758,9 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				ALL_PFI_SE_INPUTS,
 				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
 				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
@@ -273,6 +1769,10 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
 				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
 				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -283,6 +1783,9 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				ALL_PFI_SE_INPUTS,
 				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
 				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
@@ -291,6 +1794,10 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
 				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
 				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -301,6 +1808,9 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				ALL_PFI_SE_INPUTS,
 				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
 				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
@@ -309,6 +1819,10 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
 				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
 				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -319,6 +1833,9 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				ALL_PFI_SE_INPUTS,
 				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
 				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
@@ -327,6 +1844,10 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
 				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
 				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -337,6 +1858,9 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				ALL_PFI_SE_INPUTS,
 				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
 				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
@@ -345,6 +1869,10 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
 				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
 				{ &pxi_trig_rt_desc[7], TRIG_CTRL_SRC_PXITRIG(7) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -355,6 +1883,9 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				ALL_PFI_SE_INPUTS,
 				{ &pxi_trig_rt_desc[0], TRIG_CTRL_SRC_PXITRIG(0) },
 				{ &pxi_trig_rt_desc[1], TRIG_CTRL_SRC_PXITRIG(1) },
@@ -363,6 +1894,10 @@ static const struct route_terminal_desc pxi_trig_rt_desc[] = {
 				{ &pxi_trig_rt_desc[4], TRIG_CTRL_SRC_PXITRIG(4) },
 				{ &pxi_trig_rt_desc[5], TRIG_CTRL_SRC_PXITRIG(5) },
 				{ &pxi_trig_rt_desc[6], TRIG_CTRL_SRC_PXITRIG(6) },
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -375,6 +1910,8 @@ static const struct route_terminal_desc pxi_star_rt_desc[];
 	.name		= "PFI" #n,					\
 	.dest_data	= TRIG_CTRL_DEST_PFI_SE(n),			\
 	.line_state_bit	= TRIG_READ_PFI_LINE_STATE_BIT(n),		\
+	.latency_ns	= PFI_LATENCY_NS,				\
+	.jitter_ns	= PFI_JITTER_NS,				\
 	.set_input	= &triggerctrl_set_input
 
 #define PXI_STAR_INPUT(n) { &pxi_star_rt_desc[n], TRIG_CTRL_SRC_PXISTAR(n) }
@@ -416,6 +1953,9 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				PFI_SE_INPUT(1),
 				PFI_SE_INPUT(2),
 				PFI_SE_INPUT(3),
@@ -423,6 +1963,10 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				PFI_SE_INPUT(5),
 				ALL_PXI_TRIG_INPUTS,
 				ALL_PXI_STAR_INPUTS,
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -433,6 +1977,9 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				PFI_SE_INPUT(0),
 				PFI_SE_INPUT(2),
 				PFI_SE_INPUT(3),
@@ -440,6 +1987,10 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				PFI_SE_INPUT(5),
 				ALL_PXI_TRIG_INPUTS,
 				ALL_PXI_STAR_INPUTS,
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -450,6 +2001,9 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				PFI_SE_INPUT(0),
 				PFI_SE_INPUT(1),
 				PFI_SE_INPUT(3),
@@ -457,6 +2011,10 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				PFI_SE_INPUT(5),
 				ALL_PXI_TRIG_INPUTS,
 				ALL_PXI_STAR_INPUTS,
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -467,6 +2025,9 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				PFI_SE_INPUT(0),
 				PFI_SE_INPUT(1),
 				PFI_SE_INPUT(2),
@@ -474,6 +2035,10 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				PFI_SE_INPUT(5),
 				ALL_PXI_TRIG_INPUTS,
 				ALL_PXI_STAR_INPUTS,
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -484,6 +2049,9 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				PFI_SE_INPUT(0),
 				PFI_SE_INPUT(1),
 				PFI_SE_INPUT(2),
@@ -491,6 +2059,10 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				PFI_SE_INPUT(5),
 				ALL_PXI_TRIG_INPUTS,
 				ALL_PXI_STAR_INPUTS,
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -501,6 +2073,9 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
 				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
 				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
 				PFI_SE_INPUT(0),
 				PFI_SE_INPUT(1),
 				PFI_SE_INPUT(2),
@@ -508,6 +2083,10 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 				PFI_SE_INPUT(4),
 				ALL_PXI_TRIG_INPUTS,
 				ALL_PXI_STAR_INPUTS,
+				ALL_LVDS_INPUTS,
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
 				{ NULL, 0 }
 			},
 	},
@@ -517,11 +2096,16 @@ static const struct route_terminal_desc pfi_rt_desc[] = {
 	.name			= "PXI_Star" #n,				\
 	.dest_data		= TRIG_CTRL_DEST_PXISTAR(n),			\
 	.line_state_bit		= TRIG_READ_PXI_STAR_LINE_STATE_BIT(n),		\
+	.latency_ns		= PXI_STAR_LATENCY_NS,				\
+	.jitter_ns		= PXI_STAR_JITTER_NS,				\
 	.available_inputs	= (const struct route_terminal_input[])		\
 		{								\
 			{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },	\
 			{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },	\
 			{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },	\
+			{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },	\
+			{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },	\
+			{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },	\
 			ALL_PFI_SE_INPUTS,					\
 			{ NULL, 0 }						\
 		},								\
@@ -581,34 +2165,235 @@ static const struct route_terminal_desc pxi_star_rt_desc[] = {
 	},
 };
 
-static const struct route_terminal_desc clkin_rt_desc = {
-	.name		= "ClkIn"
-};
-
-static void enable_clkin(struct ni6674t *dev)
-{
-	iowrite32(CLKIN_CTRL_ENABLE(1), &dev->sync->clkinctrl);
-}
-
-static void src_a_b_set_input(struct route_terminal *rt,
+#define PXIE_DSTARB_RT_DESC_MEMBERS(n)						\
+	.name			= "PXIe_DStarB" #n,				\
+	.dest_data		= TRIG_CTRL_DEST_PXIeDSTARB(n),			\
+	.line_state_bit		= NO_LINE_STATE_BIT,				\
+	.latency_ns		= LVDS_LATENCY_NS,				\
+	.jitter_ns		= LVDS_JITTER_NS,				\
+	.available_inputs	= (const struct route_terminal_input[])		\
+		{								\
+			{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },	\
+			{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },	\
+			{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },	\
+			{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },	\
+			{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },	\
+			{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },	\
+			ALL_PFI_SE_INPUTS,					\
+			ALL_PXI_TRIG_INPUTS,					\
+			ALL_LVDS_INPUTS,					\
+			ALL_PXIE_DSTARC_INPUTS,					\
+			PXI_STAR_PERIPH_INPUT,					\
+			PXIE_DSTARB_PERIPH_INPUT,				\
+			{ NULL, 0 }						\
+		},								\
+	.set_input		= &triggerctrl_set_input
+
+static const struct route_terminal_desc pxie_dstarb_rt_desc[] = {
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(0)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(1)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(2)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(3)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(4)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(5)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(6)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(7)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(8)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(9)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(10)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(11)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(12)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(13)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(14)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(15)
+	},
+	{
+		PXIE_DSTARB_RT_DESC_MEMBERS(16)
+	},
+};
+
+#define LVDS_RT_DESC_MEMBERS(n)						\
+	.name		= "LVDS" #n,					\
+	.dest_data	= TRIG_CTRL_DEST_LVDS(n),			\
+	.line_state_bit	= NO_LINE_STATE_BIT,				\
+	.latency_ns	= LVDS_LATENCY_NS,				\
+	.jitter_ns	= LVDS_JITTER_NS,				\
+	.set_input	= &triggerctrl_set_input
+
+static const struct route_terminal_desc lvds_rt_desc[] = {
+	{
+		LVDS_RT_DESC_MEMBERS(0),
+		.available_inputs = (const struct route_terminal_input[])
+			{
+				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+				ALL_PFI_SE_INPUTS,
+				ALL_PXI_TRIG_INPUTS,
+				LVDS_INPUT(1),
+				LVDS_INPUT(2),
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
+				{ NULL, 0 }
+			},
+	},
+	{
+		LVDS_RT_DESC_MEMBERS(1),
+		.available_inputs = (const struct route_terminal_input[])
+			{
+				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+				ALL_PFI_SE_INPUTS,
+				ALL_PXI_TRIG_INPUTS,
+				LVDS_INPUT(0),
+				LVDS_INPUT(2),
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
+				{ NULL, 0 }
+			},
+	},
+	{
+		LVDS_RT_DESC_MEMBERS(2),
+		.available_inputs = (const struct route_terminal_input[])
+			{
+				{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+				{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+				{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+				{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+				{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+				{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+				ALL_PFI_SE_INPUTS,
+				ALL_PXI_TRIG_INPUTS,
+				LVDS_INPUT(0),
+				LVDS_INPUT(1),
+				ALL_PXIE_DSTARC_INPUTS,
+				PXI_STAR_PERIPH_INPUT,
+				PXIE_DSTARB_PERIPH_INPUT,
+				{ NULL, 0 }
+			},
+	},
+};
+
+/* Lines back to the system timing slot, used when this board is installed
+ *   as a peripheral. */
+static const struct route_terminal_desc pxi_star_periph_rt_desc = {
+	.name			= "PXI_StarPeriph",
+	.dest_data		= TRIG_CTRL_DEST_STAR_PERIPH,
+	.line_state_bit		= NO_LINE_STATE_BIT,
+	.latency_ns		= PXI_STAR_LATENCY_NS,
+	.jitter_ns		= PXI_STAR_JITTER_NS,
+	.set_input		= &triggerctrl_set_input,
+	.available_inputs	= (const struct route_terminal_input[])
+		{
+			{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+			{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+			{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+			{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+			{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+			{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+			ALL_PFI_SE_INPUTS,
+			ALL_PXI_TRIG_INPUTS,
+			ALL_LVDS_INPUTS,
+			PXIE_DSTARB_PERIPH_INPUT,
+			{ NULL, 0 }
+		},
+};
+
+static const struct route_terminal_desc pxie_dstarc_periph_rt_desc = {
+	.name			= "PXIe_DStarCPeriph",
+	.dest_data		= TRIG_CTRL_DEST_DSTARC_PERIPH,
+	.line_state_bit		= NO_LINE_STATE_BIT,
+	.latency_ns		= LVDS_LATENCY_NS,
+	.jitter_ns		= LVDS_JITTER_NS,
+	.set_input		= &triggerctrl_set_input,
+	.available_inputs	= (const struct route_terminal_input[])
+		{
+			{ &rt_floating,		TRIG_CTRL_SRC_FLOATING },
+			{ &rt_logic_high,	TRIG_CTRL_SRC_LOGIC_HIGH },
+			{ &rt_logic_low,	TRIG_CTRL_SRC_LOGIC_LOW },
+			{ &rt_sync_clk,		TRIG_CTRL_SRC_SYNC_CLK },
+			{ &rt_global_sw,	TRIG_CTRL_SRC_GLOBAL_SW },
+			{ &rt_local_sw,		TRIG_CTRL_SRC_LOCAL_SW },
+			ALL_PFI_SE_INPUTS,
+			ALL_PXI_TRIG_INPUTS,
+			ALL_LVDS_INPUTS,
+			PXI_STAR_PERIPH_INPUT,
+			PXIE_DSTARB_PERIPH_INPUT,
+			{ NULL, 0 }
+		},
+};
+
+static const struct route_terminal_desc clkin_rt_desc = {
+	.name		= "ClkIn"
+};
+
+static void enable_clkin(struct ni6674t *dev)
+{
+	ni6674t_iowrite32(CTR_CLKIN_WRITES, CLKIN_CTRL_ENABLE(1),
+			  &dev->sync->clkinctrl);
+}
+
+/* The fabric set_input functions are called with route_lock held */
+static void src_a_b_set_input(struct route_terminal *rt,
 			      const struct route_terminal_input *input)
 {
 	struct ni6674t *dev = rt->owner;
 	u32 regval;
 
-	mutex_lock(&dev->devlock);
-	regval = ioread32(&dev->sync->dstaractrl1);
+	regval = dev->dstaractrl1;
 
 	/* dest_data contains the field mask in this case */
 	regval &= ~rt->rt_desc->dest_data;
 	regval |= input->data;
 
-	iowrite32(regval, &dev->sync->dstaractrl1);
-	mutex_unlock(&dev->devlock);
+	dev->dstaractrl1 = regval;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, regval, &dev->sync->dstaractrl1);
 }
 
 static const struct route_terminal_desc srca_rt_desc = {
 	.name			= "SourceA",
+	.latency_ns		= DSTARA_MUX_LATENCY_NS,
+	.jitter_ns		= DSTARA_MUX_JITTER_NS,
 	.set_input		= &src_a_b_set_input,
 	.dest_data		= DSTARA_SRCA_MUX2_MASK,
 	.available_inputs	= (const struct route_terminal_input[])
@@ -620,6 +2405,8 @@ static const struct route_terminal_desc srca_rt_desc = {
 
 static const struct route_terminal_desc srcb_rt_desc = {
 	.name			= "SourceB",
+	.latency_ns		= DSTARA_MUX_LATENCY_NS,
+	.jitter_ns		= DSTARA_MUX_JITTER_NS,
 	.set_input	        = &src_a_b_set_input,
 	.dest_data		= DSTARA_SRCB_MUX2_MASK,
 	.available_inputs	= (const struct route_terminal_input[])
@@ -629,41 +2416,70 @@ static const struct route_terminal_desc srcb_rt_desc = {
 		}
 };
 
+/* The divided clocks are hard-wired to their sources; the divider is
+ *   brought into the path by SourceADividerSelect/SourceBDividerSelect. */
+static const struct route_terminal_desc srca_div_rt_desc = {
+	.name			= "SourceADivider",
+	.latency_ns		= DSTARA_DIV_LATENCY_NS,
+	.jitter_ns		= DSTARA_DIV_JITTER_NS,
+	.available_inputs	= (const struct route_terminal_input[])
+		{
+			{ &srca_rt_desc, 0 },
+			{ NULL, 0 }
+		}
+};
+
+static const struct route_terminal_desc srcb_div_rt_desc = {
+	.name			= "SourceBDivider",
+	.latency_ns		= DSTARA_DIV_LATENCY_NS,
+	.jitter_ns		= DSTARA_DIV_JITTER_NS,
+	.available_inputs	= (const struct route_terminal_input[])
+		{
+			{ &srcb_rt_desc, 0 },
+			{ NULL, 0 }
+		}
+};
+
 static void src_a_b_div_sel_set_input(struct route_terminal *rt,
 				      const struct route_terminal_input *input)
 {
 	struct ni6674t *dev = rt->owner;
 	u32 regval;
 
-	mutex_lock(&dev->devlock);
-	regval = ioread32(&dev->sync->dstaractrl2);
+	regval = dev->dstaractrl2;
 
 	/* dest_data contains the field mask in this case */
 	regval &= ~rt->rt_desc->dest_data;
 	regval |= input->data;
 
-	iowrite32(regval, &dev->sync->dstaractrl2);
-	mutex_unlock(&dev->devlock);
+	dev->dstaractrl2 = regval;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, regval, &dev->sync->dstaractrl2);
 }
 
 static const struct route_terminal_desc srca_div_sel_rt_desc = {
 	.name			= "SourceADividerSelect",
+	.latency_ns		= DSTARA_MUX_LATENCY_NS,
+	.jitter_ns		= DSTARA_MUX_JITTER_NS,
 	.set_input		= &src_a_b_div_sel_set_input,
 	.dest_data		= DSTARA_SRCA_USE_DIVIDER(1),
 	.available_inputs	= (const struct route_terminal_input[])
 		{
 			{ &srca_rt_desc, DSTARA_SRCA_USE_DIVIDER(0) },
+			{ &srca_div_rt_desc, DSTARA_SRCA_USE_DIVIDER(1) },
 			{ NULL, 0 }
 		}
 };
 
 static const struct route_terminal_desc srcb_div_sel_rt_desc = {
 	.name			= "SourceBDividerSelect",
+	.latency_ns		= DSTARA_MUX_LATENCY_NS,
+	.jitter_ns		= DSTARA_MUX_JITTER_NS,
 	.set_input		= &src_a_b_div_sel_set_input,
 	.dest_data		= DSTARA_SRCB_USE_DIVIDER(1),
 	.available_inputs	= (const struct route_terminal_input[])
 		{
 			{ &srcb_rt_desc, DSTARA_SRCB_USE_DIVIDER(0) },
+			{ &srcb_div_rt_desc, DSTARA_SRCB_USE_DIVIDER(1) },
 			{ NULL, 0 }
 		}
 };
@@ -676,19 +2492,20 @@ static void bank_set_input(struct route_terminal *rt,
 	struct ni6674t *dev = rt->owner;
 	u32 regval;
 
-	mutex_lock(&dev->devlock);
-	regval = ioread32(&dev->sync->dstaractrl1);
+	regval = dev->dstaractrl1;
 
 	/* dest_data contains the field mask in this case */
 	regval &= ~rt->rt_desc->dest_data;
 	regval |= input->data;
 
-	iowrite32(regval, &dev->sync->dstaractrl1);
-	mutex_unlock(&dev->devlock);
+	dev->dstaractrl1 = regval;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, regval, &dev->sync->dstaractrl1);
 }
 
 #define BANK_RT_DESC_MEMBERS(n)										\
 	.name			= "Bank" #n,								\
+	.latency_ns		= DSTARA_MUX_LATENCY_NS,						\
+	.jitter_ns		= DSTARA_MUX_JITTER_NS,							\
 	.set_input		= &bank_set_input,							\
 	.dest_data		= DSTARA_BANK_N_MASK(n),						\
 	.available_inputs	= (const struct route_terminal_input[])					\
@@ -716,6 +2533,8 @@ static const struct route_terminal_desc bank_rt_desc[] = {
 
 #define PXIE_DSTARA_RT_DESC_MEMBERS(n, banknum)				\
 	.name			= "PXIe_DStarA" #n,			\
+	.latency_ns		= DSTARA_LATENCY_NS,			\
+	.jitter_ns		= DSTARA_JITTER_NS,			\
 	.available_inputs	= (const struct route_terminal_input[])	\
 		{							\
 			{ &bank_rt_desc[banknum], 0 },			\
@@ -794,11 +2613,17 @@ static ssize_t route_terminal_store(struct kobject *kobj,
 {
 	struct route_terminal_attr *rt_attr;
 	struct route_terminal *rt;
+	ssize_t ret;
 
 	rt_attr = container_of(attr, struct route_terminal_attr, attr);
 	rt = container_of(kobj, struct route_terminal, kobj);
 
-	return rt_attr->store ? rt_attr->store(rt, buf, count) : -EINVAL;
+	/* Each store checks the terminal's reservation itself, under
+	 *   route_lock, together with the change it commits */
+	ret = rt_attr->store ? rt_attr->store(rt, buf, count) : -EINVAL;
+	if (ret < 0)
+		ni6674t_count(CTR_REJECTED_WRITES);
+	return ret;
 }
 
 static struct sysfs_ops route_terminal_sysfs_ops = {
@@ -809,6 +2634,10 @@ static struct sysfs_ops route_terminal_sysfs_ops = {
 static struct attribute *basic_route_terminal_default_attrs[] = {
 	&route_terminal_attr_current_input.attr,
 	&route_terminal_attr_available_inputs.attr,
+	&route_terminal_attr_fanout.attr,
+	&route_terminal_attr_consumers.attr,
+	&route_terminal_attr_unroute.attr,
+	&route_terminal_attr_latency_ns.attr,
 	NULL,
 };
 
@@ -817,6 +2646,31 @@ static struct attribute *route_terminal_default_attrs[] = {
 	&route_terminal_attr_polarity.attr,
 	&route_terminal_attr_available_inputs.attr,
 	&route_terminal_attr_line_state.attr,
+	&route_terminal_attr_sync_mode.attr,
+	&route_terminal_attr_sync_clock.attr,
+	&route_terminal_attr_sync_edge.attr,
+	&route_terminal_attr_generator.attr,
+	&route_terminal_attr_fanout.attr,
+	&route_terminal_attr_consumers.attr,
+	&route_terminal_attr_unroute.attr,
+	&route_terminal_attr_latency_ns.attr,
+	&route_terminal_attr_pxi_delay.attr,
+	NULL,
+};
+
+/* Terminals whose line state isn't reflected in the trigread registers */
+static struct attribute *no_readback_route_terminal_default_attrs[] = {
+	&route_terminal_attr_current_input.attr,
+	&route_terminal_attr_polarity.attr,
+	&route_terminal_attr_available_inputs.attr,
+	&route_terminal_attr_sync_mode.attr,
+	&route_terminal_attr_sync_clock.attr,
+	&route_terminal_attr_sync_edge.attr,
+	&route_terminal_attr_generator.attr,
+	&route_terminal_attr_fanout.attr,
+	&route_terminal_attr_consumers.attr,
+	&route_terminal_attr_unroute.attr,
+	&route_terminal_attr_latency_ns.attr,
 	NULL,
 };
 
@@ -826,20 +2680,205 @@ static struct attribute *pxi_trig_route_terminal_default_attrs[] = {
 	&route_terminal_attr_polarity.attr,
 	&route_terminal_attr_available_inputs.attr,
 	&route_terminal_attr_line_state.attr,
+	&route_terminal_attr_sync_mode.attr,
+	&route_terminal_attr_sync_clock.attr,
+	&route_terminal_attr_sync_edge.attr,
+	&route_terminal_attr_generator.attr,
+	&route_terminal_attr_fanout.attr,
+	&route_terminal_attr_consumers.attr,
+	&route_terminal_attr_unroute.attr,
+	&route_terminal_attr_latency_ns.attr,
+	&route_terminal_attr_pxi_delay.attr,
 	NULL,
 };
 
 
-static void route_terminal_release(struct kobject *kobj)
+/* Range of the PFI threshold DAC, gain 2 of a 2.5V reference (see
+ *   ni6674t_init_dac) */
+#define PFI_THRESHOLD_FULL_SCALE_MV	5000
+#define PFI_THRESHOLD_DEFAULT_CODE	60
+
+/* Polls for the DAC serial port to go idle, sleeping between polls */
+static int dac_wait_idle(struct ni6674t *dev)
 {
-	struct route_terminal *rt = container_of(kobj, struct route_terminal, kobj);
-	kfree(rt);
+	unsigned int timeout = 100;
+
+	while ((ni6674t_ioread32(CTR_DAC_READS, &dev->sync->dacctrl) &
+		DAC_CTRL_SERIAL_PORT_BUSY) && --timeout) {
+		ni6674t_count(CTR_DAC_BUSY_SPINS);
+		usleep_range(10, 20);
+	}
+
+	return timeout ? 0 : -EIO;
+}
+
+static void dac_queue_work(struct work_struct *work)
+{
+	struct ni6674t *dev = container_of(work, struct ni6674t, dac_work);
+	unsigned int line;
+	u8 code;
+
+	for (;;) {
+		spin_lock(&dev->dac_lock);
+		if (!dev->dac_pending || dev->dac_sweeping) {
+			spin_unlock(&dev->dac_lock);
+			break;
+		}
+		line = __ffs(dev->dac_pending);
+		__clear_bit(line, &dev->dac_pending);
+		code = dev->dac_codes[line];
+		spin_unlock(&dev->dac_lock);
+
+		/* The code is dropped, and the line keeps reading back the
+		 *   level the DAC still has */
+		if (dac_wait_idle(dev)) {
+			dev_err(&dev->pdev->dev, "DAC serial timeout.\n");
+			continue;
+		}
+		ni6674t_iowrite32(CTR_DAC_WRITES, DAC_CTRL_WORD(line, code),
+				  &dev->sync->dacctrl);
+
+		spin_lock(&dev->dac_lock);
+		dev->pfi_threshold[line] = code;
+		spin_unlock(&dev->dac_lock);
+	}
+}
+
+/* Queues a DAC code for a PFI line without waiting for the serial port */
+static void dac_queue_write(struct ni6674t *dev, unsigned int line, u8 code)
+{
+	spin_lock(&dev->dac_lock);
+	dev->dac_codes[line] = code;
+	__set_bit(line, &dev->dac_pending);
+	spin_unlock(&dev->dac_lock);
+
+	schedule_work(&dev->dac_work);
+}
+
+static int pfi_index(const struct route_terminal_desc *desc)
+{
+	if (desc < pfi_rt_desc || desc >= pfi_rt_desc + ARRAY_SIZE(pfi_rt_desc))
+		return -1;
+	return desc - pfi_rt_desc;
+}
+
+/* Parses a non-negative decimal voltage such as "1.4" into millivolts */
+static int parse_millivolts(const char *buf, unsigned int *mv)
+{
+	unsigned int volts = 0, frac = 0, scale = 1000;
+	const char *p = buf;
+
+	if (!isdigit(*p) && *p != '.')
+		return -EINVAL;
+
+	while (isdigit(*p)) {
+		volts = volts * 10 + (*p++ - '0');
+		if (volts > PFI_THRESHOLD_FULL_SCALE_MV / 1000)
+			return -ERANGE;
+	}
+
+	if (*p == '.') {
+		p++;
+		while (isdigit(*p)) {
+			if (scale > 1) {
+				scale /= 10;
+				frac += (*p - '0') * scale;
+			}
+			p++;
+		}
+	}
+
+	if (*p == 'V')
+		p++;
+	if (*p == '\n')
+		p++;
+	if (*p)
+		return -EINVAL;
+
+	*mv = volts * 1000 + frac;
+	return 0;
+}
+
+static unsigned int pfi_threshold_mv(unsigned int code)
+{
+	return DIV_ROUND_CLOSEST(code * PFI_THRESHOLD_FULL_SCALE_MV,
+				 DAC_CTRL_CODE_MAX);
+}
+
+static ssize_t route_terminal_threshold_show(struct route_terminal *rt,
+					     char *buf)
+{
+	unsigned int pfinum = rt->rt_desc - pfi_rt_desc;
+	unsigned int mv;
+
+	mv = pfi_threshold_mv(rt->owner->pfi_threshold[pfinum]);
+
+	return snprintf(buf, PAGE_SIZE, "%u.%03u\n", mv / 1000, mv % 1000);
+}
+
+static ssize_t route_terminal_threshold_store(struct route_terminal *rt,
+					      const char *buf, size_t count)
+{
+	unsigned int pfinum = rt->rt_desc - pfi_rt_desc;
+	struct ni6674t *dev = rt->owner;
+	unsigned long flags;
+	unsigned int mv;
+	int err;
+
+	err = parse_millivolts(buf, &mv);
+	if (err)
+		return err;
+
+	if (mv > PFI_THRESHOLD_FULL_SCALE_MV)
+		return -ERANGE;
+
+	/* A calibration sweeping the line sets its threshold when done */
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (rt->busy || reserved_by_other_process(rt)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		return -EBUSY;
+	}
+	dac_queue_write(dev, pfinum,
+			DIV_ROUND_CLOSEST(mv * DAC_CTRL_CODE_MAX,
+					  PFI_THRESHOLD_FULL_SCALE_MV));
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	return count;
+}
+
+static ROUTE_TERMINAL_ATTR(threshold, 0600);
+
+static struct attribute *pfi_route_terminal_default_attrs[] = {
+	&route_terminal_attr_current_input.attr,
+	&route_terminal_attr_polarity.attr,
+	&route_terminal_attr_available_inputs.attr,
+	&route_terminal_attr_line_state.attr,
+	&route_terminal_attr_sync_mode.attr,
+	&route_terminal_attr_sync_clock.attr,
+	&route_terminal_attr_sync_edge.attr,
+	&route_terminal_attr_generator.attr,
+	&route_terminal_attr_threshold.attr,
+	&route_terminal_attr_fanout.attr,
+	&route_terminal_attr_consumers.attr,
+	&route_terminal_attr_unroute.attr,
+	&route_terminal_attr_latency_ns.attr,
+	NULL,
+};
+
+static void free_route_terminal_arena(struct kref *ref)
+{
+	kfree(container_of(ref, struct route_terminal_arena, ref));
 }
 
-static void pxi_trig_route_terminal_release(struct kobject *kobj)
+static void route_terminal_release(struct kobject *kobj)
 {
-	struct pxi_trig_route_terminal *prt = container_of(kobj, struct pxi_trig_route_terminal, rt.kobj);
-	kfree(prt);
+	struct route_terminal *rt = container_of(kobj, struct route_terminal, kobj);
+	struct route_terminal_arena *arena;
+
+	kfree(rt->generator);
+	/* Reservations still held when the board went away */
+	put_pid(rt->holder_pid);
+	arena = container_of(rt - rt->id, struct route_terminal_arena, rt[0]);
+	kref_put(&arena->ref, free_route_terminal_arena);
 }
 
 static struct kobj_type basic_route_terminal_ktype = {
@@ -854,319 +2893,3312 @@ static struct kobj_type route_terminal_ktype = {
 	.default_attrs	= route_terminal_default_attrs,
 };
 
+static struct kobj_type pfi_route_terminal_ktype = {
+	.release	= route_terminal_release,
+	.sysfs_ops	= &route_terminal_sysfs_ops,
+	.default_attrs	= pfi_route_terminal_default_attrs,
+};
+
+static struct kobj_type no_readback_route_terminal_ktype = {
+	.release	= route_terminal_release,
+	.sysfs_ops	= &route_terminal_sysfs_ops,
+	.default_attrs	= no_readback_route_terminal_default_attrs,
+};
+
 static struct kobj_type pxi_trig_route_terminal_ktype = {
-	.release	= pxi_trig_route_terminal_release,
+	.release	= route_terminal_release,
 	.sysfs_ops	= &route_terminal_sysfs_ops,
 	.default_attrs	= pxi_trig_route_terminal_default_attrs,
 };
 
-static void release_route_terminal(struct route_terminal *rt)
+/*
+ * Every terminal in the routing graph, in terminal ID order.  The families
+ * with a directory under terminals/ come first, followed by the sources
+ * that can only be selected as an input, which have no ktype.
+ */
+struct terminal_family {
+	const struct route_terminal_desc *descs;
+	unsigned int count;
+	struct kobj_type *ktype;
+	u8 reg;
+	u8 flags;
+};
+
+#define TOPO_TRIGGERCTRL_FLAGS	(NI6674T_TOPO_HAS_DIRECTORY | \
+				 NI6674T_TOPO_POLARITY | NI6674T_TOPO_SYNC)
+
+static const struct terminal_family terminal_families[] = {
+	{ pxi_trig_rt_desc, ARRAY_SIZE(pxi_trig_rt_desc),
+	  &pxi_trig_route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS | NI6674T_TOPO_LINE_STATE },
+	{ pfi_rt_desc, ARRAY_SIZE(pfi_rt_desc),
+	  &pfi_route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS | NI6674T_TOPO_LINE_STATE |
+	  NI6674T_TOPO_THRESHOLD },
+	{ pxi_star_rt_desc, ARRAY_SIZE(pxi_star_rt_desc),
+	  &route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS | NI6674T_TOPO_LINE_STATE },
+	{ pxie_dstarb_rt_desc, ARRAY_SIZE(pxie_dstarb_rt_desc),
+	  &no_readback_route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS },
+	{ lvds_rt_desc, ARRAY_SIZE(lvds_rt_desc),
+	  &no_readback_route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS },
+	{ &pxi_star_periph_rt_desc, 1,
+	  &no_readback_route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS },
+	{ &pxie_dstarc_periph_rt_desc, 1,
+	  &no_readback_route_terminal_ktype, NI6674T_TOPO_REG_TRIGGERCTRL,
+	  TOPO_TRIGGERCTRL_FLAGS },
+	{ &srca_rt_desc, 1,
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_DSTARACTRL1,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ &srcb_rt_desc, 1,
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_DSTARACTRL1,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ &srca_div_rt_desc, 1,
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_NONE,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ &srcb_div_rt_desc, 1,
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_NONE,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ &srca_div_sel_rt_desc, 1,
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_DSTARACTRL2,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ &srcb_div_sel_rt_desc, 1,
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_DSTARACTRL2,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ bank_rt_desc, ARRAY_SIZE(bank_rt_desc),
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_DSTARACTRL1,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ dstara_rt_desc, ARRAY_SIZE(dstara_rt_desc),
+	  &basic_route_terminal_ktype, NI6674T_TOPO_REG_NONE,
+	  NI6674T_TOPO_HAS_DIRECTORY },
+	{ &rt_floating, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ &rt_logic_high, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ &rt_logic_low, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ &rt_sync_clk, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ &rt_global_sw, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ &rt_local_sw, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ &clkin_rt_desc, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+	{ pxie_dstarc_rt_desc, ARRAY_SIZE(pxie_dstarc_rt_desc), NULL,
+	  NI6674T_TOPO_REG_NONE, 0 },
+	{ &pxie_dstarb_periph_rt_desc, 1, NULL, NI6674T_TOPO_REG_NONE, 0 },
+};
+
+/* Returns the terminal ID of desc, or -1 if it isn't in the graph */
+static int terminal_id(const struct route_terminal_desc *desc)
+{
+	const struct terminal_family *f;
+	int i, base = 0;
+
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++) {
+		f = &terminal_families[i];
+		if (desc >= f->descs && desc < f->descs + f->count)
+			return base + (desc - f->descs);
+		base += f->count;
+	}
+
+	return -1;
+}
+
+/* Returns the named terminal with a reference held, or NULL */
+static struct route_terminal *get_route_terminal(struct ni6674t *dev,
+						 const char *name)
+{
+	struct kobject *kobj;
+
+	kobj = kset_find_obj(dev->terminal_set, name);
+	return kobj ? container_of(kobj, struct route_terminal, kobj) : NULL;
+}
+
+static void put_route_terminal(struct route_terminal *rt)
 {
 	kobject_put(&rt->kobj);
 }
 
-static int init_and_add_route_terminal(struct ni6674t *dev,
-				       struct route_terminal *rt,
-				       struct kobj_type *ktype,
-				       const struct route_terminal_desc *desc)
+static int init_and_add_route_terminal(struct ni6674t *dev,
+				       struct route_terminal *rt,
+				       struct kobj_type *ktype,
+				       const struct route_terminal_desc *desc)
+{
+	rt->owner = dev;
+	rt->rt_desc = desc;
+	rt->kobj.kset = dev->terminal_set;
+
+	/* The default route is programmed for the whole board at once by
+	 *   program_default_routes() once every terminal exists. */
+	rt->input = &desc->available_inputs[0];
+
+	/* Dropped by route_terminal_release() */
+	kref_get(&dev->terminals->ref);
+	return kobject_init_and_add(&rt->kobj, ktype, NULL, desc->name);
+}
+
+static void release_route_terminals(struct ni6674t *dev)
+{
+	struct route_terminal_arena *arena = dev->terminals;
+	int i;
+
+	for (i = arena->count - 1; i >= 0; --i) {
+		pulse_generator_stop(&arena->rt[i]);
+		kobject_put(&arena->rt[i].kobj);
+	}
+	kref_put(&arena->ref, free_route_terminal_arena);
+}
+
+/*
+ * All of a device's terminals live in one block, indexed by terminal ID.
+ * The block is freed once the device and every terminal kobject have let
+ * go of it.
+ */
+static int __devinit init_route_terminals(struct ni6674t *dev)
+{
+	const struct terminal_family *f;
+	struct route_terminal_arena *arena;
+	unsigned int count = 0;
+	int i, j, id, err;
+
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++)
+		if (terminal_families[i].ktype)
+			count += terminal_families[i].count;
+
+	if (WARN_ON(count > ROUTE_TERMINALS_MAX))
+		return -EINVAL;
+
+	arena = kzalloc(sizeof(*arena) + count * sizeof(arena->rt[0]),
+			GFP_KERNEL);
+	if (!arena)
+		return -ENOMEM;
+
+	kref_init(&arena->ref);
+	dev->terminals = arena;
+
+	for (i = 0, id = 0; i < ARRAY_SIZE(terminal_families); i++) {
+		f = &terminal_families[i];
+		if (!f->ktype)
+			continue;
+
+		for (j = 0; j < f->count; j++, id++) {
+			arena->rt[id].id = id;
+			err = init_and_add_route_terminal(dev, &arena->rt[id],
+							  f->ktype,
+							  &f->descs[j]);
+			if (err) {
+				kobject_put(&arena->rt[id].kobj);
+				goto fail_add;
+			}
+			arena->count++;
+		}
+	}
+
+	/* Every source exists now, so the consumers can be recorded */
+	for (i = 0; i < arena->count; i++) {
+		id = terminal_id(arena->rt[i].input->desc);
+		if (id >= 0 && id < arena->count)
+			set_bit(i, arena->rt[id].consumers);
+	}
+	return 0;
+
+fail_add:
+	release_route_terminals(dev);
+	return err;
+}
+
+static int __devinit ni6674t_dac_write(struct ni6674t *dev,
+				       struct pci_dev *pdev,
+				       u32 val)
+{
+	if (dac_wait_idle(dev)) {
+		dev_err(&pdev->dev, "DAC serial timeout.\n");
+		return -EIO;
+	}
+
+	ni6674t_iowrite32(CTR_DAC_WRITES, val, &dev->sync->dacctrl);
+	return 0;
+}
+
+static int __devinit ni6674t_init_dac(struct ni6674t *dev,
+				      struct pci_dev *pdev)
+{
+	int pfinum, err;
+	/* FIXME: This code is mostly borrowed from the Windows driver
+	 * (w/ accompanying documentation).  Remember to document the meaning of
+    * these magic numbers. */
+
+	/* Set DAC_ChipSelect to PFI Threshold DAC */
+	/* Sets gain of output amplifier and reference selection options */
+	err = ni6674t_dac_write(dev, pdev, 0x800c);
+	if (err) return err;
+
+	/* LDAC options */
+	err = ni6674t_dac_write(dev, pdev, 0xa000);
+	if (err) return err;
+
+	/* Power-down options */
+	err = ni6674t_dac_write(dev, pdev, 0xc000);
+	if (err) return err;
+
+	/* DAC Register Write (for each pfi line) */
+	for (pfinum=0; pfinum < 6; ++pfinum) {
+		dev->pfi_threshold[pfinum] = PFI_THRESHOLD_DEFAULT_CODE;
+		err = ni6674t_dac_write(dev, pdev,
+					DAC_CTRL_WORD(pfinum, PFI_THRESHOLD_DEFAULT_CODE));
+		if (err) return err;
+	}
+
+	spin_lock_init(&dev->dac_lock);
+	INIT_WORK(&dev->dac_work, dac_queue_work);
+	return 0;
+}
+
+static bool is_dstara_fabric_terminal(const struct route_terminal_desc *desc)
+{
+	return desc->set_input == &src_a_b_set_input ||
+	       desc->set_input == &src_a_b_div_sel_set_input ||
+	       desc->set_input == &bank_set_input;
+}
+
+/* Folds a DStarA fabric route into the control register values */
+static void dstara_fold_route(u32 *ctrl1, u32 *ctrl2,
+			      const struct route_terminal_desc *desc,
+			      const struct route_terminal_input *input)
+{
+	/* dest_data contains the field mask for these terminals */
+	if (desc->set_input == &src_a_b_div_sel_set_input)
+		*ctrl2 = (*ctrl2 & ~desc->dest_data) | input->data;
+	else
+		*ctrl1 = (*ctrl1 & ~desc->dest_data) | input->data;
+}
+
+static ssize_t dstara_plan_show(struct device *d,
+				struct device_attribute *attr, char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_terminal *rt;
+	unsigned long flags;
+	size_t total = 0;
+	int i;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < dev->terminals->count; i++) {
+		rt = &dev->terminals->rt[i];
+		if (!is_dstara_fabric_terminal(rt->rt_desc))
+			continue;
+		total += scnprintf(buf + total, PAGE_SIZE - total, "%s%s=%s",
+				   total ? " " : "", rt->rt_desc->name,
+				   rt->input->desc->name);
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	total += scnprintf(buf + total, PAGE_SIZE - total, "\n");
+	return total;
+}
+
+/* Applies a whole DStarA clock plan, written as space-separated
+ *   Terminal=Input pairs, with one write to each control register. */
+static ssize_t dstara_plan_store(struct device *d,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_assignment plan[8];
+	struct route_terminal *rt;
+	char *copy, *cur, *tok, *eq;
+	int i, n = 0, err = 0;
+	unsigned long flags;
+	u32 ctrl1, ctrl2;
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	cur = copy;
+	while ((tok = strsep(&cur, " \t\n"))) {
+		if (!*tok)
+			continue;
+
+		eq = strchr(tok, '=');
+		if (!eq) {
+			err = -EINVAL;
+			goto out;
+		}
+		*eq++ = '\0';
+
+		if (n == ARRAY_SIZE(plan)) {
+			err = -E2BIG;
+			goto out;
+		}
+
+		rt = get_route_terminal(dev, tok);
+		if (!rt) {
+			err = -ENOENT;
+			goto out;
+		}
+		plan[n++].rt = rt;
+
+		if (!is_dstara_fabric_terminal(rt->rt_desc)) {
+			err = -EINVAL;
+			goto out;
+		}
+
+		plan[n - 1].input = find_available_input(rt->rt_desc, eq,
+							 strlen(eq));
+		if (!plan[n - 1].input) {
+			err = -EINVAL;
+			goto out;
+		}
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n; i++) {
+		if (reserved_by_other_process(plan[i].rt)) {
+			spin_unlock_irqrestore(&dev->route_lock, flags);
+			err = -EBUSY;
+			goto out;
+		}
+	}
+
+	ctrl1 = dev->dstaractrl1;
+	ctrl2 = dev->dstaractrl2;
+	for (i = 0; i < n; i++)
+		dstara_fold_route(&ctrl1, &ctrl2, plan[i].rt->rt_desc,
+				  plan[i].input);
+
+	/* Dividers first, so the banks switch straight onto the final clocks */
+	dev->dstaractrl2 = ctrl2;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, ctrl2, &dev->sync->dstaractrl2);
+	dev->dstaractrl1 = ctrl1;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, ctrl1, &dev->sync->dstaractrl1);
+
+	for (i = 0; i < n; i++)
+		update_terminal_input(plan[i].rt, plan[i].input);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	notify_route_changes(dev, plan, n);
+
+out:
+	while (--n >= 0)
+		put_route_terminal(plan[n].rt);
+	kfree(copy);
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(dstara_plan, 0600, dstara_plan_show, dstara_plan_store);
+
+/*
+ * Programs the default route of every terminal in one pass once all of
+ * them exist.  The crossbar takes one triggerctrl write per destination,
+ * while the DStarA fabric gets a single write of each control register.
+ */
+static void __devinit program_default_routes(struct ni6674t *dev)
+{
+	struct route_terminal *rt;
+	unsigned long flags;
+	u32 ctrl1, ctrl2;
+	int i;
+
+	/* Start the DStarA shadows from whatever the FPGA came up with */
+	ctrl1 = ni6674t_ioread32(CTR_DSTARA_READS, &dev->sync->dstaractrl1);
+	ctrl2 = ni6674t_ioread32(CTR_DSTARA_READS, &dev->sync->dstaractrl2);
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < dev->terminals->count; i++) {
+		rt = &dev->terminals->rt[i];
+		if (rt->rt_desc->set_input == &triggerctrl_set_input)
+			triggerctrl_flush_terminal_attrs(rt);
+		else if (is_dstara_fabric_terminal(rt->rt_desc))
+			dstara_fold_route(&ctrl1, &ctrl2, rt->rt_desc,
+					  rt->input);
+	}
+
+	dev->dstaractrl2 = ctrl2;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, ctrl2, &dev->sync->dstaractrl2);
+	dev->dstaractrl1 = ctrl1;
+	ni6674t_iowrite32(CTR_DSTARA_WRITES, ctrl1, &dev->sync->dstaractrl1);
+	mmiowb();
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	/* FIXME: We're just enabling ClkIn by default here.  In the future,
+	 * we'll probably want to lazily enable ClkIn the first time it's used.
+	 * We'll probably also want to ref count it to make sure it's not
+	 * prematurely disabled. */
+	enable_clkin(dev);
+}
+
+/* Records the time since *start against phase and restarts the clock */
+static void __devinit probe_phase_done(struct ni6674t *dev,
+				       enum probe_phase phase, ktime_t *start)
+{
+	ktime_t now = ktime_get();
+
+	dev->probe_ns[phase] += ktime_to_ns(ktime_sub(now, *start));
+	*start = now;
+}
+
+static ssize_t probe_times_show(struct device *d,
+				struct device_attribute *attr, char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < NR_PROBE_PHASES; i++)
+		total += scnprintf(buf + total, PAGE_SIZE - total, "%s %llu\n",
+				   probe_phase_strs[i],
+				   (unsigned long long) div_u64(dev->probe_ns[i],
+								NSEC_PER_USEC));
+	return total;
+}
+
+static DEVICE_ATTR(probe_times, 0444, probe_times_show, NULL);
+
+#define SELFTEST_MAX_ITERATIONS	10000
+
+/* Switches rt's source to the given logic level and returns the time until
+ *   the line follows, or -1 if it never did. */
+static s64 time_line_transition(struct route_terminal *rt, u32 trigctrl,
+				int level)
+{
+	struct ni6674t *dev = rt->owner;
+	unsigned int timeout = PULSE_READBACK_LIMIT;
+	ktime_t start;
+	int state;
+	s64 ns;
+
+	trigctrl |= TRIG_CTRL_SRC(level ? TRIG_CTRL_SRC_LOGIC_HIGH :
+					  TRIG_CTRL_SRC_LOGIC_LOW);
+
+	preempt_disable();
+	start = ktime_get();
+	ni6674t_iowrite32(CTR_TRIG_WRITES, trigctrl, &dev->sync->triggerctrl);
+	do {
+		state = read_line_state(rt);
+	} while (state != level && --timeout);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	preempt_enable();
+
+	return state == level ? ns : -1;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *) a, y = *(const u32 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Toggles rt between logic_low and logic_high, timing both edges, then
+ *   restores its route and gives back the claim on it taken through busy.
+ *   samples must hold 2 * iterations entries. */
+static void selftest_terminal(struct route_terminal *rt,
+			      unsigned int iterations, u32 *samples,
+			      struct selftest_result *res)
+{
+	u32 trigctrl = TRIG_CTRL_DEST(rt->rt_desc->dest_data) |
+		       TRIG_CTRL_ENABLED | TRIG_CTRL_ASYNCHRONOUS;
+	struct ni6674t *dev = rt->owner;
+	unsigned int i, n = 0;
+	unsigned long flags;
+	s64 ns;
+
+	memset(res, 0, sizeof(*res));
+	res->rt = rt;
+
+	/* Start from a known low level */
+	time_line_transition(rt, trigctrl, 0);
+
+	for (i = 0; i < 2 * iterations; i++) {
+		ns = time_line_transition(rt, trigctrl, !(i & 1));
+		if (ns < 0)
+			res->timeouts++;
+		else
+			samples[n++] = min_t(s64, ns, U32_MAX);
+		cond_resched();
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	triggerctrl_flush_terminal_attrs(rt);
+	rt->busy = false;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	res->samples = n;
+	if (!n)
+		return;
+
+	sort(samples, n, sizeof(*samples), cmp_u32, NULL);
+	res->min = samples[0];
+	res->median = samples[n / 2];
+	res->p99 = samples[DIV_ROUND_UP(n * 99, 100) - 1];
+}
+
+static ssize_t selftest_show(struct device *d,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct selftest_result *res;
+	size_t total;
+	int i;
+
+	total = scnprintf(buf, PAGE_SIZE,
+			  "terminal samples timeouts min_ns median_ns p99_ns\n");
+
+	mutex_lock(&dev->devlock);
+	for (i = 0; i < dev->selftest_count; i++) {
+		res = &dev->selftest[i];
+		total += scnprintf(buf + total, PAGE_SIZE - total,
+				   "%s %u %u %u %u %u\n",
+				   res->rt->rt_desc->name, res->samples,
+				   res->timeouts, res->min, res->median,
+				   res->p99);
+	}
+	mutex_unlock(&dev->devlock);
+
+	return total;
+}
+
+/* Writing an iteration count runs the loopback test on every terminal
+ *   with line state readback. */
+static ssize_t selftest_store(struct device *d,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct selftest_result *results;
+	struct route_terminal *rt;
+	unsigned int iterations, n = 0;
+	unsigned long flags;
+	u32 *samples;
+	bool skip;
+	int i, err;
+
+	err = kstrtouint(buf, 0, &iterations);
+	if (err)
+		return err;
+
+	if (!iterations || iterations > SELFTEST_MAX_ITERATIONS)
+		return -EINVAL;
+
+	results = kcalloc(dev->terminals->count, sizeof(*results), GFP_KERNEL);
+	samples = vmalloc(2 * iterations * sizeof(*samples));
+	if (!results || !samples) {
+		kfree(results);
+		vfree(samples);
+		return -ENOMEM;
+	}
+
+	/* Only the terminal under test is claimed, and devlock is only held
+	 *   while it is timed, so everything else stays usable meanwhile */
+	for (i = 0; i < dev->terminals->count; i++) {
+		rt = &dev->terminals->rt[i];
+		if (rt->rt_desc->set_input != &triggerctrl_set_input ||
+		    rt->rt_desc->line_state_bit == NO_LINE_STATE_BIT)
+			continue;
+
+		/* Leave lines that someone else is driving alone */
+		spin_lock_irqsave(&dev->route_lock, flags);
+		skip = terminal_busy(rt) || reserved_by_other_process(rt);
+		if (!skip)
+			rt->busy = true;
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		if (skip)
+			continue;
+
+		mutex_lock(&dev->devlock);
+		selftest_terminal(rt, iterations, samples, &results[n++]);
+		mutex_unlock(&dev->devlock);
+	}
+
+	mutex_lock(&dev->devlock);
+	kfree(dev->selftest);
+	dev->selftest = results;
+	dev->selftest_count = n;
+	mutex_unlock(&dev->devlock);
+
+	vfree(samples);
+	return count;
+}
+
+static DEVICE_ATTR(selftest, 0600, selftest_show, selftest_store);
+
+#define PXI_DELAY_CAL_DEFAULT_ITERATIONS	100
+
+static bool is_pxi_delay_terminal(const struct route_terminal_desc *desc)
+{
+	return (desc >= pxi_trig_rt_desc &&
+		desc < pxi_trig_rt_desc + ARRAY_SIZE(pxi_trig_rt_desc)) ||
+	       (desc >= pxi_star_rt_desc &&
+		desc < pxi_star_rt_desc + ARRAY_SIZE(pxi_star_rt_desc));
+}
+
+static ssize_t pxi_delays_show(struct device *d,
+			       struct device_attribute *attr, char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_terminal *rt;
+	unsigned long flags;
+	size_t total = 0;
+	int i;
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < dev->terminals->count; i++) {
+		rt = &dev->terminals->rt[i];
+		if (is_pxi_delay_terminal(rt->rt_desc))
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   "%s=%u\n", rt->rt_desc->name,
+					   rt->pxi_delay);
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	return total;
+}
+
+/* Applies a "Terminal=delay ..." table, such as one read from pxi_delays */
+static ssize_t pxi_delays_store(struct device *d,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_terminal **rts, *rt;
+	unsigned int *delays;
+	char *copy, *cur, *tok, *eq;
+	int i, n = 0, err = 0;
+	unsigned long flags;
+
+	rts = kcalloc(dev->terminals->count, sizeof(*rts), GFP_KERNEL);
+	delays = kcalloc(dev->terminals->count, sizeof(*delays), GFP_KERNEL);
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!rts || !delays || !copy) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((tok = strsep(&cur, " \t\n"))) {
+		if (!*tok)
+			continue;
+
+		eq = strchr(tok, '=');
+		if (!eq || n == dev->terminals->count) {
+			err = -EINVAL;
+			goto out;
+		}
+		*eq++ = '\0';
+
+		rt = get_route_terminal(dev, tok);
+		if (!rt) {
+			err = -ENOENT;
+			goto out;
+		}
+		rts[n] = rt;
+		put_route_terminal(rt);
+
+		if (!is_pxi_delay_terminal(rt->rt_desc) ||
+		    kstrtouint(eq, 0, &delays[n]) ||
+		    delays[n] > TRIG_CTRL_PXI_DELAY_MAX) {
+			err = -EINVAL;
+			goto out;
+		}
+		n++;
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n; i++) {
+		if (terminal_busy(rts[i]) ||
+		    reserved_by_other_process(rts[i])) {
+			err = -EBUSY;
+			goto out_unlock;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		rts[i]->pxi_delay = delays[i];
+		triggerctrl_flush_terminal_attrs(rts[i]);
+	}
+out_unlock:
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+out:
+	kfree(copy);
+	kfree(delays);
+	kfree(rts);
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(pxi_delays, 0600, pxi_delays_show, pxi_delays_store);
+
+/* Median time for rt to follow a logic_low to logic_high switch of its
+ *   source with the given delay setting, or U32_MAX if it never did. */
+static u32 pxi_delay_arrival(struct route_terminal *rt, unsigned int delay,
+			     unsigned int iterations, u32 *samples)
+{
+	u32 trigctrl = TRIG_CTRL_DEST(rt->rt_desc->dest_data) |
+		       TRIG_CTRL_ENABLED | TRIG_CTRL_ASYNCHRONOUS |
+		       TRIG_CTRL_PXI_DELAY(delay);
+	unsigned int i, n = 0;
+	s64 ns;
+
+	for (i = 0; i < iterations; i++) {
+		cond_resched();
+		if (time_line_transition(rt, trigctrl, 0) < 0)
+			continue;
+		ns = time_line_transition(rt, trigctrl, 1);
+		if (ns >= 0)
+			samples[n++] = min_t(s64, ns, U32_MAX);
+	}
+
+	if (!n)
+		return U32_MAX;
+
+	sort(samples, n, sizeof(*samples), cmp_u32, NULL);
+	return samples[n / 2];
+}
+
+static ssize_t pxi_delay_calibrate_show(struct device *d,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct pxi_delay_cal *cal;
+	size_t total;
+	int i, j;
+
+	total = scnprintf(buf, PAGE_SIZE, "terminal delay");
+	for (j = 0; j <= TRIG_CTRL_PXI_DELAY_MAX; j++)
+		total += scnprintf(buf + total, PAGE_SIZE - total, " d%d_ns", j);
+	total += scnprintf(buf + total, PAGE_SIZE - total, "\n");
+
+	mutex_lock(&dev->devlock);
+	for (i = 0; i < dev->pxi_cal_count; i++) {
+		cal = &dev->pxi_cal[i];
+		total += scnprintf(buf + total, PAGE_SIZE - total, "%s %u",
+				   cal->rt->rt_desc->name, cal->delay);
+		for (j = 0; j <= TRIG_CTRL_PXI_DELAY_MAX; j++)
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   " %u", cal->arrival[j]);
+		total += scnprintf(buf + total, PAGE_SIZE - total, "\n");
+	}
+	mutex_unlock(&dev->devlock);
+
+	return total;
+}
+
+/*
+ * Measures how long every selected PXI_Trig/PXI_Star terminal takes to
+ * follow its source at each delay setting, then gives each terminal the
+ * setting that brings it closest to the slowest terminal's undelayed
+ * arrival.  Written values are terminal names or patterns, optionally
+ * followed by iterations=<n>.
+ */
+static ssize_t pxi_delay_calibrate_store(struct device *d,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	unsigned int iterations = PXI_DELAY_CAL_DEFAULT_ITERATIONS;
+	struct route_terminal_arena *arena = dev->terminals;
+	char *copy, *cur, *tok, *pats[16];
+	struct pxi_delay_cal *results, *cal;
+	struct route_terminal *rt;
+	int i, j, n = 0, npats = 0, err = 0;
+	u32 *samples = NULL, target = 0, best, diff;
+	unsigned long flags;
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	results = kcalloc(arena->count, sizeof(*results), GFP_KERNEL);
+	if (!copy || !results) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((tok = strsep(&cur, " ,\t\n"))) {
+		if (!*tok)
+			continue;
+		if (!strncmp(tok, "iterations=", 11)) {
+			err = kstrtouint(tok + 11, 0, &iterations);
+			if (err || !iterations ||
+			    iterations > SELFTEST_MAX_ITERATIONS) {
+				err = -EINVAL;
+				goto out;
+			}
+		} else if (npats < ARRAY_SIZE(pats)) {
+			pats[npats++] = tok;
+		} else {
+			err = -E2BIG;
+			goto out;
+		}
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < arena->count; i++) {
+		rt = &arena->rt[i];
+		if (!is_pxi_delay_terminal(rt->rt_desc))
+			continue;
+		for (j = 0; j < npats; j++)
+			if (terminal_name_match(pats[j], rt->rt_desc->name))
+				break;
+		if (j == npats)
+			continue;
+
+		if (terminal_busy(rt) || reserved_by_other_process(rt)) {
+			err = -EBUSY;
+			break;
+		}
+		results[n++].rt = rt;
+	}
+
+	/* Skew is relative, so it takes at least two terminals */
+	if (!err && n < 2)
+		err = -EINVAL;
+
+	/* The selected terminals stay claimed until their delays are set,
+	 *   so nobody routes or reserves them in between */
+	for (i = 0; !err && i < n; i++)
+		results[i].rt->busy = true;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	if (err)
+		goto out;
+
+	samples = vmalloc(iterations * sizeof(*samples));
+	if (!samples) {
+		err = -ENOMEM;
+		goto out_release;
+	}
+
+	/* devlock only keeps other measurements off the bus, and is let go
+	 *   between terminals */
+	for (i = 0; i < n; i++) {
+		cal = &results[i];
+		mutex_lock(&dev->devlock);
+		for (j = 0; j <= TRIG_CTRL_PXI_DELAY_MAX; j++)
+			cal->arrival[j] = pxi_delay_arrival(cal->rt, j,
+							    iterations,
+							    samples);
+		mutex_unlock(&dev->devlock);
+
+		spin_lock_irqsave(&dev->route_lock, flags);
+		triggerctrl_flush_terminal_attrs(cal->rt);
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+
+		if (cal->arrival[0] == U32_MAX) {
+			dev_err(&dev->pdev->dev,
+				"%s does not follow its source.\n",
+				cal->rt->rt_desc->name);
+			err = -EIO;
+			goto out_release;
+		}
+		target = max(target, cal->arrival[0]);
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n; i++) {
+		cal = &results[i];
+		best = U32_MAX;
+		for (j = 0; j <= TRIG_CTRL_PXI_DELAY_MAX; j++) {
+			if (cal->arrival[j] == U32_MAX)
+				continue;
+			diff = cal->arrival[j] > target ?
+			       cal->arrival[j] - target :
+			       target - cal->arrival[j];
+			if (diff < best) {
+				best = diff;
+				cal->delay = j;
+			}
+		}
+
+		cal->rt->pxi_delay = cal->delay;
+		triggerctrl_flush_terminal_attrs(cal->rt);
+		cal->rt->busy = false;
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	mutex_lock(&dev->devlock);
+	kfree(dev->pxi_cal);
+	dev->pxi_cal = results;
+	dev->pxi_cal_count = n;
+	results = NULL;
+	mutex_unlock(&dev->devlock);
+	goto out;
+
+out_release:
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n; i++)
+		results[i].rt->busy = false;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+out:
+	vfree(samples);
+	kfree(results);
+	kfree(copy);
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(pxi_delay_calibrate, 0600, pxi_delay_calibrate_show,
+		   pxi_delay_calibrate_store);
+
+#define PFI_CAL_DEFAULT_SAMPLES	256
+#define PFI_CAL_MAX_SAMPLES	1024
+/* Time for the PFI comparators to follow a new DAC code */
+#define PFI_CAL_SETTLE_US	5
+/* Narrowest band, in DAC codes, that is taken for a toggling line rather
+ *   than comparator noise around a static level */
+#define PFI_CAL_MIN_SPAN	4
+
+/* Writes a DAC word right away.  Only for threshold calibration, which
+ *   holds the queue off with dac_sweeping. */
+static int dac_write_now(struct ni6674t *dev, u32 word)
+{
+	if (dac_wait_idle(dev))
+		return -EIO;
+
+	ni6674t_iowrite32(CTR_DAC_WRITES, word, &dev->sync->dacctrl);
+	return 0;
+}
+
+/* Steps the threshold of every line in cal through the whole DAC range
+ *   together, sampling the PFI line states at each step, and records the
+ *   band of codes over which each line was seen both low and high. */
+static int pfi_threshold_sweep(struct ni6674t *dev,
+			       struct pfi_threshold_cal *cal, int n,
+			       unsigned int samples)
+{
+	u32 trigread, seen_low, seen_high, bit;
+	unsigned int code, i;
+	int j, err;
+
+	/* All six PFI line states come from a single register */
+	BUILD_BUG_ON(TRIG_READ_PFI_LINE_STATE_BIT(ARRAY_SIZE(pfi_rt_desc) - 1)
+		     >= 32);
+
+	for (j = 0; j < n; j++) {
+		cal[j].low = DAC_CTRL_CODE_MAX + 1;
+		cal[j].high = 0;
+	}
+
+	for (code = 0; code <= DAC_CTRL_CODE_MAX; code++) {
+		for (j = 0; j < n; j++) {
+			err = dac_write_now(dev,
+				DAC_CTRL_WORD(pfi_index(cal[j].rt->rt_desc),
+					      code));
+			if (err)
+				return err;
+		}
+		udelay(PFI_CAL_SETTLE_US);
+
+		seen_low = 0;
+		seen_high = 0;
+		for (i = 0; i < samples; i++) {
+			trigread = ni6674t_ioread32(CTR_TRIG_READS,
+						    &dev->sync->trigread[0]);
+			seen_low |= ~trigread;
+			seen_high |= trigread;
+		}
+
+		for (j = 0; j < n; j++) {
+			bit = 1 << cal[j].rt->rt_desc->line_state_bit;
+			if ((seen_low & bit) && cal[j].low > code)
+				cal[j].low = code;
+			if (seen_high & bit)
+				cal[j].high = code;
+		}
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static ssize_t pfi_threshold_calibrate_show(struct device *d,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct pfi_threshold_cal *cal;
+	unsigned int mv;
+	size_t total;
+	int i;
+
+	total = scnprintf(buf, PAGE_SIZE, "terminal low high code threshold\n");
+
+	mutex_lock(&dev->devlock);
+	for (i = 0; i < dev->pfi_cal_count; i++) {
+		cal = &dev->pfi_cal[i];
+		mv = pfi_threshold_mv(cal->code);
+		if (cal->found)
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   "%s %u %u", cal->rt->rt_desc->name,
+					   cal->low, cal->high);
+		else
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   "%s - -", cal->rt->rt_desc->name);
+		total += scnprintf(buf + total, PAGE_SIZE - total,
+				   " %u %u.%03u\n", cal->code, mv / 1000,
+				   mv % 1000);
+	}
+	mutex_unlock(&dev->devlock);
+
+	return total;
+}
+
+/*
+ * Sweeps the threshold of every selected PFI line over the DAC range while
+ * the line is driven from outside, and sets it to the midpoint of the band
+ * over which the line toggled.  Written values are terminal names or
+ * patterns, optionally followed by samples=<n>, the number of line state
+ * reads at each code.  Lines that never toggle keep their threshold, and
+ * make the write fail with -EIO once the others are set.
+ */
+static ssize_t pfi_threshold_calibrate_store(struct device *d,
+					     struct device_attribute *attr,
+					     const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	unsigned int samples = PFI_CAL_DEFAULT_SAMPLES;
+	struct route_terminal_arena *arena = dev->terminals;
+	struct pfi_threshold_cal results[ARRAY_SIZE(dev->pfi_cal)];
+	char *copy, *cur, *tok, *pats[16];
+	struct pfi_threshold_cal *cal;
+	struct route_terminal *rt;
+	int i, j, pfinum, n = 0, npats = 0, err = 0;
+	unsigned long flags;
+	bool sweeping;
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	cur = copy;
+	while ((tok = strsep(&cur, " ,\t\n"))) {
+		if (!*tok)
+			continue;
+		if (!strncmp(tok, "samples=", 8)) {
+			err = kstrtouint(tok + 8, 0, &samples);
+			if (err || !samples || samples > PFI_CAL_MAX_SAMPLES) {
+				err = -EINVAL;
+				goto out;
+			}
+		} else if (npats < ARRAY_SIZE(pats)) {
+			pats[npats++] = tok;
+		} else {
+			err = -E2BIG;
+			goto out;
+		}
+	}
+
+	memset(results, 0, sizeof(results));
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < arena->count; i++) {
+		rt = &arena->rt[i];
+		if (pfi_index(rt->rt_desc) < 0)
+			continue;
+		for (j = 0; j < npats; j++)
+			if (terminal_name_match(pats[j], rt->rt_desc->name))
+				break;
+		if (j == npats)
+			continue;
+
+		/* A line the board drives would only measure itself */
+		if (rt->input->desc != &rt_floating ||
+		    terminal_busy(rt) || reserved_by_other_process(rt)) {
+			err = -EBUSY;
+			break;
+		}
+		results[n++].rt = rt;
+	}
+
+	if (!err && !n)
+		err = -EINVAL;
+
+	/* The lines stay claimed until their thresholds are queued, so
+	 *   nobody routes, reserves or sets them while they are swept */
+	for (i = 0; !err && i < n; i++)
+		results[i].rt->busy = true;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	if (err)
+		goto out;
+
+	/* Only one calibration drives the DAC at a time */
+	spin_lock(&dev->dac_lock);
+	sweeping = dev->dac_sweeping;
+	dev->dac_sweeping = true;
+	spin_unlock(&dev->dac_lock);
+	if (sweeping) {
+		err = -EBUSY;
+		goto out_release;
+	}
+	flush_work(&dev->dac_work);
+
+	err = pfi_threshold_sweep(dev, results, n, samples);
+
+	spin_lock(&dev->dac_lock);
+	dev->dac_sweeping = false;
+	spin_unlock(&dev->dac_lock);
+
+	for (i = 0; i < n; i++) {
+		cal = &results[i];
+		pfinum = pfi_index(cal->rt->rt_desc);
+		cal->found = !err && cal->low <= DAC_CTRL_CODE_MAX &&
+			     cal->high >= cal->low + PFI_CAL_MIN_SPAN;
+		cal->code = cal->found ? (cal->low + cal->high + 1) / 2 :
+					 dev->pfi_threshold[pfinum];
+
+		/* Also puts back the threshold of the lines that failed */
+		dac_queue_write(dev, pfinum, cal->code);
+
+		if (!cal->found && !err) {
+			dev_warn(&dev->pdev->dev,
+				 "%s does not toggle across its threshold range.\n",
+				 cal->rt->rt_desc->name);
+			err = -EIO;
+		}
+	}
+
+	mutex_lock(&dev->devlock);
+	memcpy(dev->pfi_cal, results, n * sizeof(*results));
+	dev->pfi_cal_count = n;
+	mutex_unlock(&dev->devlock);
+
+out_release:
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n; i++)
+		results[i].rt->busy = false;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+out:
+	kfree(copy);
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(pfi_threshold_calibrate, 0600,
+		   pfi_threshold_calibrate_show,
+		   pfi_threshold_calibrate_store);
+
+static const char *route_schedule_state_strs[] = {
+	[SCHEDULE_EMPTY]	= "empty",
+	[SCHEDULE_LOADED]	= "loaded",
+	[SCHEDULE_ARMED]	= "armed",
+	[SCHEDULE_DONE]		= "done",
+};
+
+/* Applies every step that is due, then waits for the next one.  Each step
+ *   is checked and committed under route_lock, like any other write. */
+static enum hrtimer_restart route_schedule_timer(struct hrtimer *timer)
+{
+	struct route_schedule *sched = container_of(timer, struct route_schedule,
+						    timer);
+	struct ni6674t *dev = container_of(sched, struct ni6674t, schedule);
+	struct route_step *step;
+	unsigned long flags;
+	s64 elapsed;
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), sched->start));
+	while (sched->next < sched->nsteps &&
+	       sched->steps[sched->next].offset_ns <= elapsed) {
+		step = &sched->steps[sched->next++];
+
+		spin_lock_irqsave(&dev->route_lock, flags);
+		/* Taken over, or resynchronized, since it was loaded */
+		if (terminal_busy(step->rt) ||
+		    reserved_by_other(step->rt, NULL) ||
+		    validate_sync_mode(step->input, step->rt->sync_mode)) {
+			spin_unlock_irqrestore(&dev->route_lock, flags);
+			step->skipped = true;
+			continue;
+		}
+		if (step->polarity >= 0)
+			set_terminal_polarity(step->rt, step->polarity);
+		set_input_and_update_state(step->rt, step->input);
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+
+		step->actual_ns = ktime_to_ns(ktime_sub(ktime_get(),
+							sched->start));
+	}
+
+	if (sched->next < sched->nsteps) {
+		hrtimer_set_expires(timer, ktime_add_ns(sched->start,
+				sched->steps[sched->next].offset_ns));
+		return HRTIMER_RESTART;
+	}
+
+	sched->state = SCHEDULE_DONE;
+	schedule_work(&sched->notify_work);
+	return HRTIMER_NORESTART;
+}
+
+/* uevents can't be sent from the timer, so they follow once it's done */
+static void route_schedule_notify(struct work_struct *work)
+{
+	struct route_schedule *sched = container_of(work, struct route_schedule,
+						    notify_work);
+	struct ni6674t *dev = container_of(sched, struct ni6674t, schedule);
+	int i;
+
+	mutex_lock(&dev->devlock);
+	if (sched->state == SCHEDULE_DONE)
+		for (i = 0; i < sched->nsteps; i++)
+			if (!sched->steps[i].skipped)
+				notify_route_change(sched->steps[i].rt);
+	mutex_unlock(&dev->devlock);
+}
+
+/* Cancels and empties the schedule.  Called with devlock held. */
+static void route_schedule_clear(struct route_schedule *sched)
+{
+	hrtimer_cancel(&sched->timer);
+	while (sched->nsteps)
+		put_route_terminal(sched->steps[--sched->nsteps].rt);
+	sched->next = 0;
+	sched->state = SCHEDULE_EMPTY;
+}
+
+/* Parses one "<offset_ns> <Terminal> <Input> [polarity]" line */
+static int route_schedule_parse_step(struct ni6674t *dev, char *line,
+				     struct route_step *step)
+{
+	char *tok[4] = { NULL };
+	int n = 0, err;
+
+	while (n < ARRAY_SIZE(tok) && (tok[n] = strsep(&line, " \t")))
+		if (*tok[n])
+			n++;
+
+	if (n < 3 || (line && *skip_spaces(line)))
+		return -EINVAL;
+
+	err = kstrtoull(tok[0], 0, &step->offset_ns);
+	if (err)
+		return err;
+
+	step->actual_ns = -1;
+	step->polarity = -1;
+	if (n == 4) {
+		step->polarity = match_terminal_attr_str(terminal_polarity_strs,
+					ARRAY_SIZE(terminal_polarity_strs),
+					tok[3]);
+		if (step->polarity < 0)
+			return -EINVAL;
+	}
+
+	step->rt = get_route_terminal(dev, tok[1]);
+	if (!step->rt)
+		return -ENOENT;
+
+	if (reserved_by_other(step->rt, NULL)) {
+		put_route_terminal(step->rt);
+		return -EBUSY;
+	}
+
+	/* Other set_input functions sleep, so they can't run from the timer */
+	step->input = find_available_input(step->rt->rt_desc, tok[2],
+					   strlen(tok[2]));
+	if (step->rt->rt_desc->set_input != &triggerctrl_set_input ||
+	    !step->input || validate_sync_mode(step->input,
+					       step->rt->sync_mode)) {
+		put_route_terminal(step->rt);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static ssize_t route_schedule_show(struct device *d,
+				   struct device_attribute *attr, char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_schedule *sched = &dev->schedule;
+	struct route_step *step;
+	size_t total;
+	int i;
+
+	mutex_lock(&dev->devlock);
+	total = scnprintf(buf, PAGE_SIZE, "%s\n",
+			  route_schedule_state_strs[sched->state]);
+	for (i = 0; i < sched->nsteps; i++) {
+		step = &sched->steps[i];
+		total += scnprintf(buf + total, PAGE_SIZE - total,
+				   "%llu %s %s %s",
+				   (unsigned long long) step->offset_ns,
+				   step->rt->rt_desc->name,
+				   step->input->desc->name,
+				   step->polarity < 0 ? "-" :
+				   terminal_polarity_strs[step->polarity]);
+		if (step->skipped)
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   " skipped\n");
+		else if (i < sched->next)
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   " %lld %lld\n",
+					   (long long) step->actual_ns,
+					   (long long) (step->actual_ns -
+							step->offset_ns));
+		else
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   " - -\n");
+	}
+	mutex_unlock(&dev->devlock);
+
+	return total;
+}
+
+/* Loads a schedule, one step per line, or arms or cancels the loaded one */
+static ssize_t route_schedule_store(struct device *d,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_schedule *sched = &dev->schedule;
+	struct route_step *steps;
+	char *copy, *cur, *line;
+	u64 last = 0;
+	int i, n = 0, err = 0;
+
+	/* A finished schedule can be armed again */
+	if (sysfs_streq(buf, "arm")) {
+		mutex_lock(&dev->devlock);
+		if (sched->state == SCHEDULE_LOADED ||
+		    sched->state == SCHEDULE_DONE) {
+			for (i = 0; i < sched->nsteps; i++) {
+				sched->steps[i].actual_ns = -1;
+				sched->steps[i].skipped = false;
+			}
+			sched->next = 0;
+			sched->state = SCHEDULE_ARMED;
+			sched->start = ktime_get();
+			hrtimer_start(&sched->timer,
+				      ktime_add_ns(sched->start,
+						   sched->steps[0].offset_ns),
+				      HRTIMER_MODE_ABS);
+		} else {
+			err = -EINVAL;
+		}
+		mutex_unlock(&dev->devlock);
+		return err ? err : count;
+	}
+
+	if (sysfs_streq(buf, "cancel")) {
+		mutex_lock(&dev->devlock);
+		route_schedule_clear(sched);
+		mutex_unlock(&dev->devlock);
+		return count;
+	}
+
+	steps = kcalloc(ROUTE_SCHEDULE_MAX_STEPS, sizeof(*steps), GFP_KERNEL);
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!steps || !copy) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((line = strsep(&cur, "\n;"))) {
+		line = strim(line);
+		if (!*line)
+			continue;
+
+		if (n == ROUTE_SCHEDULE_MAX_STEPS) {
+			err = -E2BIG;
+			goto out;
+		}
+
+		err = route_schedule_parse_step(dev, line, &steps[n]);
+		if (err)
+			goto out;
+
+		/* Steps are applied in order, so their offsets can't go back */
+		if (steps[n++].offset_ns < last) {
+			err = -EINVAL;
+			goto out;
+		}
+		last = steps[n - 1].offset_ns;
+	}
+
+	if (!n) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&dev->devlock);
+	route_schedule_clear(sched);
+	memcpy(sched->steps, steps, n * sizeof(*steps));
+	sched->nsteps = n;
+	sched->state = SCHEDULE_LOADED;
+	mutex_unlock(&dev->devlock);
+	n = 0;
+
+out:
+	while (--n >= 0)
+		put_route_terminal(steps[n].rt);
+	kfree(copy);
+	kfree(steps);
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(route_schedule, 0600, route_schedule_show,
+		   route_schedule_store);
+
+static const char *route_rule_cond_strs[] = {
+	[RULE_RISE]	= "rise",
+	[RULE_FALL]	= "fall",
+	[RULE_HIGH]	= "high",
+	[RULE_LOW]	= "low",
+};
+
+static const char *route_rule_state_strs[] = {
+	[RULE_ARMED]	= "armed",
+	[RULE_WAITING]	= "waiting",
+	[RULE_SPENT]	= "spent",
+};
+
+static bool route_rule_hit(const struct route_rule *rule, int prev, int level)
+{
+	switch (rule->cond) {
+	case RULE_RISE:
+		return prev == 0 && level;
+	case RULE_FALL:
+		return prev == 1 && !level;
+	case RULE_HIGH:
+		return level;
+	case RULE_LOW:
+		return !level;
+	}
+	return false;
+}
+
+/* Samples the watched line states and applies the route change of every
+ *   rule whose condition holds, checking and committing it under
+ *   route_lock.  The reaction time runs from the previous sample, the last
+ *   one known to be before the edge, to the end of the register write. */
+static enum hrtimer_restart route_rules_timer(struct hrtimer *timer)
+{
+	struct route_rules *rules = container_of(timer, struct route_rules,
+						 timer);
+	struct ni6674t *dev = container_of(rules, struct ni6674t, rules);
+	struct route_rule *rule;
+	unsigned long flags;
+	unsigned int bit, i;
+	u32 now[3] = { 0 };
+	int prev, level;
+	ktime_t t, since;
+	bool fired = false;
+	u64 ns;
+
+	t = ktime_get();
+	for (i = 0; i < ARRAY_SIZE(now); i++)
+		if (rules->words & (1 << i))
+			now[i] = ni6674t_ioread32(CTR_TRIG_READS,
+						  &dev->sync->trigread[i]);
+
+	/* Nothing to compare the first sample with */
+	since = rules->samples ? rules->last_sample : t;
+
+	for (i = 0; i < rules->nrules; i++) {
+		rule = &rules->rules[i];
+		bit = rule->watch->rt_desc->line_state_bit;
+		level = !!(now[bit / 32] & (1 << (bit % 32)));
+		prev = rules->samples ?
+		       !!(rules->last[bit / 32] & (1 << (bit % 32))) : -1;
+
+		if (rule->state == RULE_WAITING &&
+		    !route_rule_hit(rule, prev, level))
+			rule->state = RULE_ARMED;
+		if (rule->state != RULE_ARMED ||
+		    !route_rule_hit(rule, prev, level))
+			continue;
+
+		if (!rule->rearm)
+			rule->state = RULE_SPENT;
+		else if (rule->cond == RULE_HIGH || rule->cond == RULE_LOW)
+			rule->state = RULE_WAITING;
+
+		/* Taken over, or resynchronized, since the rules were loaded;
+		 *   the condition is used up all the same */
+		spin_lock_irqsave(&dev->route_lock, flags);
+		if (terminal_busy(rule->rt) ||
+		    reserved_by_other(rule->rt, NULL) ||
+		    validate_sync_mode(rule->input, rule->rt->sync_mode)) {
+			spin_unlock_irqrestore(&dev->route_lock, flags);
+			rule->skips++;
+			continue;
+		}
+
+		if (rule->polarity >= 0)
+			set_terminal_polarity(rule->rt, rule->polarity);
+		set_input_and_update_state(rule->rt, rule->input);
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+
+		ns = ktime_to_ns(ktime_sub(ktime_get(), since));
+		if (!rule->fires || ns < rule->min_ns)
+			rule->min_ns = ns;
+		if (ns > rule->max_ns)
+			rule->max_ns = ns;
+		rule->sum_ns += ns;
+		rule->fires++;
+
+		set_bit(i, rules->fired);
+		fired = true;
+	}
+
+	memcpy(rules->last, now, sizeof(now));
+	rules->last_sample = t;
+	rules->samples++;
+
+	if (fired)
+		schedule_work(&rules->notify_work);
+
+	hrtimer_forward_now(timer, ns_to_ktime(rules->period_ns));
+	return HRTIMER_RESTART;
+}
+
+/* uevents can't be sent from the timer, so they follow from a work item */
+static void route_rules_notify(struct work_struct *work)
+{
+	struct route_rules *rules = container_of(work, struct route_rules,
+						 notify_work);
+	struct ni6674t *dev = container_of(rules, struct ni6674t, rules);
+	int i;
+
+	mutex_lock(&dev->devlock);
+	for (i = 0; i < rules->nrules; i++)
+		if (test_and_clear_bit(i, rules->fired))
+			notify_route_change(rules->rules[i].rt);
+	mutex_unlock(&dev->devlock);
+}
+
+/* Stops sampling.  Called with devlock held. */
+static void route_rules_stop(struct route_rules *rules)
+{
+	hrtimer_cancel(&rules->timer);
+	rules->running = false;
+}
+
+/* Stops sampling and drops every rule.  Called with devlock held. */
+static void route_rules_clear(struct route_rules *rules)
+{
+	struct route_rule *rule;
+
+	route_rules_stop(rules);
+	while (rules->nrules) {
+		rule = &rules->rules[--rules->nrules];
+		put_route_terminal(rule->watch);
+		put_route_terminal(rule->rt);
+	}
+	bitmap_zero(rules->fired, ROUTE_RULES_MAX);
+	rules->words = 0;
+}
+
+/* Parses one
+ *   "<Watch> rise|fall|high|low <Terminal> <Input> [polarity] [once|rearm]"
+ *   line */
+static int route_rule_parse(struct ni6674t *dev, char *line,
+			    struct route_rule *rule)
+{
+	char *tok[6] = { NULL };
+	int n = 0, i, cond, err = -EINVAL;
+
+	while (n < ARRAY_SIZE(tok) && (tok[n] = strsep(&line, " \t")))
+		if (*tok[n])
+			n++;
+
+	if (n < 4 || (line && *skip_spaces(line)))
+		return -EINVAL;
+
+	cond = match_terminal_attr_str(route_rule_cond_strs,
+				       ARRAY_SIZE(route_rule_cond_strs),
+				       tok[1]);
+	if (cond < 0)
+		return -EINVAL;
+	rule->cond = cond;
+
+	rule->polarity = -1;
+	rule->rearm = false;
+	for (i = 4; i < n; i++) {
+		if (!strcmp(tok[i], "once") || !strcmp(tok[i], "rearm")) {
+			rule->rearm = tok[i][0] == 'r';
+			continue;
+		}
+		/* As read back, for a rule that leaves the polarity alone */
+		if (!strcmp(tok[i], "-"))
+			continue;
+		rule->polarity = match_terminal_attr_str(terminal_polarity_strs,
+					ARRAY_SIZE(terminal_polarity_strs),
+					tok[i]);
+		if (rule->polarity < 0)
+			return -EINVAL;
+	}
+
+	rule->watch = get_route_terminal(dev, tok[0]);
+	if (!rule->watch)
+		return -ENOENT;
+
+	rule->rt = get_route_terminal(dev, tok[2]);
+	if (!rule->rt) {
+		err = -ENOENT;
+		goto fail_rt;
+	}
+
+	if (reserved_by_other(rule->rt, NULL)) {
+		err = -EBUSY;
+		goto fail;
+	}
+
+	/* Other set_input functions sleep, so they can't run from the timer */
+	rule->input = find_available_input(rule->rt->rt_desc, tok[3],
+					   strlen(tok[3]));
+	if (rule->watch->rt_desc->line_state_bit == NO_LINE_STATE_BIT ||
+	    rule->rt->rt_desc->set_input != &triggerctrl_set_input ||
+	    !rule->input || validate_sync_mode(rule->input,
+					       rule->rt->sync_mode))
+		goto fail;
+
+	return 0;
+
+fail:
+	put_route_terminal(rule->rt);
+fail_rt:
+	put_route_terminal(rule->watch);
+	return err;
+}
+
+static ssize_t route_rules_show(struct device *d,
+				struct device_attribute *attr, char *buf)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_rules *rules = &dev->rules;
+	struct route_rule *rule;
+	size_t total;
+	int i;
+
+	mutex_lock(&dev->devlock);
+	total = scnprintf(buf, PAGE_SIZE, "%s period_ns=%llu samples=%llu\n",
+			  rules->running ? "running" : "stopped",
+			  (unsigned long long) rules->period_ns,
+			  (unsigned long long) rules->samples);
+	for (i = 0; i < rules->nrules; i++) {
+		rule = &rules->rules[i];
+		total += scnprintf(buf + total, PAGE_SIZE - total,
+				   "%s %s %s %s %s %s %s %u %u",
+				   rule->watch->rt_desc->name,
+				   route_rule_cond_strs[rule->cond],
+				   rule->rt->rt_desc->name,
+				   rule->input->desc->name,
+				   rule->polarity < 0 ? "-" :
+				   terminal_polarity_strs[rule->polarity],
+				   rule->rearm ? "rearm" : "once",
+				   route_rule_state_strs[rule->state],
+				   rule->fires, rule->skips);
+		if (rule->fires)
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   " %llu %llu %llu\n",
+					   (unsigned long long) rule->min_ns,
+					   (unsigned long long)
+					   div_u64(rule->sum_ns, rule->fires),
+					   (unsigned long long) rule->max_ns);
+		else
+			total += scnprintf(buf + total, PAGE_SIZE - total,
+					   " - - -\n");
+	}
+	mutex_unlock(&dev->devlock);
+
+	return total;
+}
+
+/* Loads a rule set, one rule per line, or starts, stops or clears it */
+static ssize_t route_rules_store(struct device *d,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_rules *rules = &dev->rules;
+	u64 period_ns = ROUTE_RULES_DEFAULT_PERIOD_NS;
+	struct route_rule *new;
+	char *copy, *cur, *line;
+	unsigned int words = 0, bit;
+	int i, n = 0, err = 0;
+
+	/* Arming resets the statistics and re-arms spent rules */
+	if (sysfs_streq(buf, "arm")) {
+		mutex_lock(&dev->devlock);
+		if (rules->nrules) {
+			route_rules_stop(rules);
+			for (i = 0; i < rules->nrules; i++) {
+				rules->rules[i].state = RULE_ARMED;
+				rules->rules[i].fires = 0;
+				rules->rules[i].skips = 0;
+				rules->rules[i].min_ns = 0;
+				rules->rules[i].max_ns = 0;
+				rules->rules[i].sum_ns = 0;
+			}
+			rules->samples = 0;
+			rules->running = true;
+			hrtimer_start(&rules->timer,
+				      ns_to_ktime(rules->period_ns),
+				      HRTIMER_MODE_REL);
+		} else {
+			err = -EINVAL;
+		}
+		mutex_unlock(&dev->devlock);
+		return err ? err : count;
+	}
+
+	if (sysfs_streq(buf, "stop") || sysfs_streq(buf, "clear")) {
+		mutex_lock(&dev->devlock);
+		if (buf[0] == 's')
+			route_rules_stop(rules);
+		else
+			route_rules_clear(rules);
+		mutex_unlock(&dev->devlock);
+		return count;
+	}
+
+	new = kcalloc(ROUTE_RULES_MAX, sizeof(*new), GFP_KERNEL);
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!new || !copy) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((line = strsep(&cur, "\n;"))) {
+		line = strim(line);
+		if (!*line)
+			continue;
+
+		if (!strncmp(line, "period_ns=", 10)) {
+			err = kstrtoull(line + 10, 0, &period_ns);
+			if (err || period_ns < ROUTE_RULES_MIN_PERIOD_NS) {
+				err = -EINVAL;
+				goto out;
+			}
+			continue;
+		}
+
+		if (n == ROUTE_RULES_MAX) {
+			err = -E2BIG;
+			goto out;
+		}
+
+		err = route_rule_parse(dev, line, &new[n]);
+		if (err)
+			goto out;
+
+		bit = new[n++].watch->rt_desc->line_state_bit;
+		words |= 1 << (bit / 32);
+	}
+
+	if (!n) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&dev->devlock);
+	route_rules_clear(rules);
+	memcpy(rules->rules, new, n * sizeof(*new));
+	rules->nrules = n;
+	rules->words = words;
+	rules->period_ns = period_ns;
+	rules->samples = 0;
+	mutex_unlock(&dev->devlock);
+	n = 0;
+
+out:
+	while (--n >= 0) {
+		put_route_terminal(new[n].watch);
+		put_route_terminal(new[n].rt);
+	}
+	kfree(copy);
+	kfree(new);
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(route_rules, 0600, route_rules_show, route_rules_store);
+
+/* Starts every armed pulse train with a common first edge */
+static ssize_t generator_start_store(struct device *d,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(d);
+	struct route_terminal *rt;
+	unsigned long flags;
+	ktime_t start;
+	int i;
+
+	mutex_lock(&dev->devlock);
+	spin_lock_irqsave(&dev->route_lock, flags);
+	start = ktime_add_ns(ktime_get(), GENERATOR_START_LEAD_NS);
+	for (i = 0; i < dev->terminals->count; i++) {
+		rt = &dev->terminals->rt[i];
+		if (rt->generator && rt->generator->state == GENERATOR_ARMED)
+			pulse_generator_start(rt->generator, start);
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	mutex_unlock(&dev->devlock);
+
+	return count;
+}
+
+static DEVICE_ATTR(generator_start, 0200, NULL, generator_start_store);
+
+static const char *topo_reg_strs[] = {
+	[NI6674T_TOPO_REG_NONE]		= "none",
+	[NI6674T_TOPO_REG_TRIGGERCTRL]	= "triggerctrl",
+	[NI6674T_TOPO_REG_DSTARACTRL1]	= "dstaractrl1",
+	[NI6674T_TOPO_REG_DSTARACTRL2]	= "dstaractrl2",
+};
+
+/* Indexed by bit number of the NI6674T_TOPO_* flags */
+static const char *topo_flag_strs[] = {
+	"directory", "line_state", "polarity", "sync", "threshold",
+};
+
+/*
+ * The text topology is printed twice: once with a NULL buffer to size it
+ * and once to fill it.
+ */
+struct topo_buf {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+static void topo_printf(struct topo_buf *b, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	b->len += vsnprintf(b->buf ? b->buf + b->len : NULL,
+			    b->buf ? b->size - b->len : 0, fmt, args);
+	va_end(args);
+}
+
+static void print_topology(struct topo_buf *b)
+{
+	const struct terminal_family *f;
+	const struct route_terminal_desc *desc;
+	const struct route_terminal_input *in;
+	const char *sep;
+	int i, j, k, id = 0;
+
+	topo_printf(b, "{\"version\":%d,\"terminals\":[", NI6674T_TOPO_VERSION);
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++) {
+		f = &terminal_families[i];
+		for (j = 0; j < f->count; j++, id++) {
+			desc = &f->descs[j];
+			topo_printf(b, "%s\n{\"id\":%d,\"name\":\"%s\","
+				    "\"register\":\"%s\",\"dest_data\":%u,",
+				    id ? "," : "", id, desc->name,
+				    topo_reg_strs[f->reg], desc->dest_data);
+
+			if (f->flags & NI6674T_TOPO_LINE_STATE)
+				topo_printf(b, "\"line_state_bit\":%u,",
+					    desc->line_state_bit);
+			else
+				topo_printf(b, "\"line_state_bit\":null,");
+
+			topo_printf(b, "\"latency_ns\":%u,\"jitter_ns\":%u,",
+				    desc->latency_ns, desc->jitter_ns);
+
+			topo_printf(b, "\"capabilities\":[");
+			for (k = 0, sep = ""; k < ARRAY_SIZE(topo_flag_strs); k++) {
+				if (!(f->flags & (1 << k)))
+					continue;
+				topo_printf(b, "%s\"%s\"", sep, topo_flag_strs[k]);
+				sep = ",";
+			}
+
+			topo_printf(b, "],\"inputs\":[");
+			in = desc->available_inputs;
+			for (sep = ""; in && in->desc; in++, sep = ",")
+				topo_printf(b, "%s[%d,%lu]", sep,
+					    terminal_id(in->desc), in->data);
+			topo_printf(b, "]}");
+		}
+	}
+	topo_printf(b, "\n]}\n");
+}
+
+static void *build_topology_bin(size_t *size)
+{
+	const struct terminal_family *f;
+	const struct route_terminal_desc *desc;
+	const struct route_terminal_input *in;
+	struct ni6674t_topo_header *hdr;
+	struct ni6674t_topo_terminal *term;
+	struct ni6674t_topo_edge *edge;
+	size_t nterms = 0, nedges = 0, names_size = 0;
+	char *names;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++) {
+		f = &terminal_families[i];
+		for (j = 0; j < f->count; j++) {
+			desc = &f->descs[j];
+			nterms++;
+			names_size += strlen(desc->name) + 1;
+			in = desc->available_inputs;
+			for (; in && in->desc; in++)
+				nedges++;
+		}
+	}
+
+	*size = sizeof(*hdr) + nterms * sizeof(*term) +
+		nedges * sizeof(*edge) + names_size;
+	hdr = vzalloc(*size);
+	if (!hdr)
+		return NULL;
+
+	term = (struct ni6674t_topo_terminal *) (hdr + 1);
+	edge = (struct ni6674t_topo_edge *) (term + nterms);
+	names = (char *) (edge + nedges);
+
+	hdr->magic = NI6674T_TOPO_MAGIC;
+	hdr->version = NI6674T_TOPO_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->num_terminals = nterms;
+	hdr->terminals_offset = (char *) term - (char *) hdr;
+	hdr->num_edges = nedges;
+	hdr->edges_offset = (char *) edge - (char *) hdr;
+	hdr->names_size = names_size;
+	hdr->names_offset = names - (char *) hdr;
+
+	nedges = 0;
+	names_size = 0;
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++) {
+		f = &terminal_families[i];
+		for (j = 0; j < f->count; j++, term++) {
+			desc = &f->descs[j];
+			term->name_offset = names_size;
+			term->first_edge = nedges;
+			term->reg = f->reg;
+			term->flags = f->flags;
+			term->dest_data = desc->dest_data;
+			term->line_state_bit = (f->flags & NI6674T_TOPO_LINE_STATE) ?
+					       desc->line_state_bit :
+					       NO_LINE_STATE_BIT;
+			term->latency_ns = desc->latency_ns;
+			term->jitter_ns = desc->jitter_ns;
+
+			strcpy(names + names_size, desc->name);
+			names_size += strlen(desc->name) + 1;
+
+			in = desc->available_inputs;
+			for (; in && in->desc; in++, edge++, nedges++) {
+				edge->input_id = terminal_id(in->desc);
+				edge->data = in->data;
+			}
+			term->num_edges = nedges - term->first_edge;
+		}
+	}
+
+	return hdr;
+}
+
+static int __devinit build_topology(struct ni6674t *dev)
+{
+	struct topo_buf b = { NULL, 0, 0 };
+
+	print_topology(&b);
+	b.size = b.len + 1;
+	b.len = 0;
+	b.buf = vmalloc(b.size);
+	if (!b.buf)
+		return -ENOMEM;
+	print_topology(&b);
+
+	dev->topology_bin = build_topology_bin(&dev->topology_bin_size);
+	if (!dev->topology_bin) {
+		vfree(b.buf);
+		return -ENOMEM;
+	}
+
+	dev->topology = b.buf;
+	dev->topology_size = b.len;
+	return 0;
+}
+
+static void release_topology(struct ni6674t *dev)
+{
+	vfree(dev->topology_bin);
+	vfree(dev->topology);
+}
+
+static ssize_t topology_read(struct file *filp, struct kobject *kobj,
+			     struct bin_attribute *attr, char *buf,
+			     loff_t off, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(container_of(kobj, struct device,
+							   kobj));
+	return memory_read_from_buffer(buf, count, &off, dev->topology,
+				       dev->topology_size);
+}
+
+static ssize_t topology_bin_read(struct file *filp, struct kobject *kobj,
+				 struct bin_attribute *attr, char *buf,
+				 loff_t off, size_t count)
+{
+	struct ni6674t *dev = dev_get_drvdata(container_of(kobj, struct device,
+							   kobj));
+	return memory_read_from_buffer(buf, count, &off, dev->topology_bin,
+				       dev->topology_bin_size);
+}
+
+/* The topology outgrows a page, so these are binary attributes */
+static struct bin_attribute topology_attr = {
+	.attr	= { .name = "topology", .mode = 0444 },
+	.read	= topology_read,
+};
+
+static struct bin_attribute topology_bin_attr = {
+	.attr	= { .name = "topology.bin", .mode = 0444 },
+	.read	= topology_bin_read,
+};
+
+static int __devinit ni6674t_init_sysfs(struct ni6674t *dev,
+					struct pci_dev *pdev)
+{
+	ktime_t start = ktime_get();
+	int err = 0;
+
+	dev->terminal_set = kset_create_and_add("terminals", NULL,
+						&pdev->dev.kobj);
+	if (!dev->terminal_set) {
+		err = -ENOMEM;
+		goto fail_alloc_term_kset;
+	}
+
+	err = init_route_terminals(dev);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to initialize route terminals.\n");
+		goto fail_terminals_init;
+	}
+	probe_phase_done(dev, PROBE_PHASE_TERMINALS, &start);
+
+	program_default_routes(dev);
+	probe_phase_done(dev, PROBE_PHASE_ROUTING, &start);
+
+	err = device_create_file(&pdev->dev, &dev_attr_dstara_plan);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create dstara_plan.\n");
+		goto fail_dstara_plan;
+	}
+
+	err = build_topology(dev);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to build routing topology.\n");
+		goto fail_build_topology;
+	}
+
+	err = sysfs_create_bin_file(&pdev->dev.kobj, &topology_attr);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create topology.\n");
+		goto fail_topology;
+	}
+
+	err = sysfs_create_bin_file(&pdev->dev.kobj, &topology_bin_attr);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create topology.bin.\n");
+		goto fail_topology_bin;
+	}
+
+	err = device_create_file(&pdev->dev, &dev_attr_probe_times);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create probe_times.\n");
+		goto fail_probe_times;
+	}
+
+	err = device_create_file(&pdev->dev, &dev_attr_selftest);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create selftest.\n");
+		goto fail_selftest;
+	}
+
+	hrtimer_init(&dev->schedule.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	dev->schedule.timer.function = route_schedule_timer;
+	INIT_WORK(&dev->schedule.notify_work, route_schedule_notify);
+
+	err = device_create_file(&pdev->dev, &dev_attr_route_schedule);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create route_schedule.\n");
+		goto fail_route_schedule;
+	}
+
+	err = device_create_file(&pdev->dev, &dev_attr_generator_start);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create generator_start.\n");
+		goto fail_generator_start;
+	}
+
+	err = device_create_file(&pdev->dev, &dev_attr_pxi_delays);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create pxi_delays.\n");
+		goto fail_pxi_delays;
+	}
+
+	err = device_create_file(&pdev->dev, &dev_attr_pxi_delay_calibrate);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create pxi_delay_calibrate.\n");
+		goto fail_pxi_delay_calibrate;
+	}
+
+	err = device_create_file(&pdev->dev, &dev_attr_pfi_threshold_calibrate);
+	if (err) {
+		dev_err(&pdev->dev,
+			"Failed to create pfi_threshold_calibrate.\n");
+		goto fail_pfi_threshold_calibrate;
+	}
+
+	hrtimer_init(&dev->rules.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dev->rules.timer.function = route_rules_timer;
+	INIT_WORK(&dev->rules.notify_work, route_rules_notify);
+	dev->rules.period_ns = ROUTE_RULES_DEFAULT_PERIOD_NS;
+
+	err = device_create_file(&pdev->dev, &dev_attr_route_rules);
+	if (err) {
+		dev_err(&pdev->dev, "Failed to create route_rules.\n");
+		goto fail_route_rules;
+	}
+
+	return 0;
+
+fail_route_rules:
+	device_remove_file(&pdev->dev, &dev_attr_pfi_threshold_calibrate);
+fail_pfi_threshold_calibrate:
+	device_remove_file(&pdev->dev, &dev_attr_pxi_delay_calibrate);
+fail_pxi_delay_calibrate:
+	device_remove_file(&pdev->dev, &dev_attr_pxi_delays);
+fail_pxi_delays:
+	device_remove_file(&pdev->dev, &dev_attr_generator_start);
+fail_generator_start:
+	device_remove_file(&pdev->dev, &dev_attr_route_schedule);
+
+fail_route_schedule:
+	device_remove_file(&pdev->dev, &dev_attr_selftest);
+fail_selftest:
+	device_remove_file(&pdev->dev, &dev_attr_probe_times);
+fail_probe_times:
+	sysfs_remove_bin_file(&pdev->dev.kobj, &topology_bin_attr);
+fail_topology_bin:
+	sysfs_remove_bin_file(&pdev->dev.kobj, &topology_attr);
+fail_topology:
+	release_topology(dev);
+fail_build_topology:
+	device_remove_file(&pdev->dev, &dev_attr_dstara_plan);
+fail_dstara_plan:
+	release_route_terminals(dev);
+fail_terminals_init:
+	kset_put(dev->terminal_set);
+fail_alloc_term_kset:
+	return err;
+}
+
+static void ni6674t_release_sysfs(struct ni6674t *dev)
+{
+	device_remove_file(&dev->pdev->dev, &dev_attr_route_rules);
+	hrtimer_cancel(&dev->rules.timer);
+	cancel_work_sync(&dev->rules.notify_work);
+	mutex_lock(&dev->devlock);
+	route_rules_clear(&dev->rules);
+	mutex_unlock(&dev->devlock);
+
+	device_remove_file(&dev->pdev->dev, &dev_attr_pfi_threshold_calibrate);
+	device_remove_file(&dev->pdev->dev, &dev_attr_pxi_delay_calibrate);
+	kfree(dev->pxi_cal);
+	device_remove_file(&dev->pdev->dev, &dev_attr_pxi_delays);
+	device_remove_file(&dev->pdev->dev, &dev_attr_generator_start);
+	device_remove_file(&dev->pdev->dev, &dev_attr_route_schedule);
+	hrtimer_cancel(&dev->schedule.timer);
+	cancel_work_sync(&dev->schedule.notify_work);
+	mutex_lock(&dev->devlock);
+	route_schedule_clear(&dev->schedule);
+	mutex_unlock(&dev->devlock);
+
+	device_remove_file(&dev->pdev->dev, &dev_attr_selftest);
+	kfree(dev->selftest);
+	device_remove_file(&dev->pdev->dev, &dev_attr_probe_times);
+	sysfs_remove_bin_file(&dev->pdev->dev.kobj, &topology_bin_attr);
+	sysfs_remove_bin_file(&dev->pdev->dev.kobj, &topology_attr);
+	release_topology(dev);
+	device_remove_file(&dev->pdev->dev, &dev_attr_dstara_plan);
+	release_route_terminals(dev);
+
+	kset_put(dev->terminal_set);
+}
+
+static void ni6674t_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct ni6674t, ref));
+}
+
+static long ni6674t_ioctl_fire(struct ni6674t *dev, struct file *file,
+			       void __user *arg)
+{
+	struct ni6674t_fire fire;
+	struct route_terminal *rt;
+	unsigned long flags;
+	int err = 0;
+
+	if (copy_from_user(&fire, arg, sizeof(fire)))
+		return -EFAULT;
+
+	if (fire.reserved)
+		return -EINVAL;
+
+	fire.terminal[sizeof(fire.terminal) - 1] = '\0';
+	rt = get_route_terminal(dev, fire.terminal);
+	if (!rt)
+		return -ENOENT;
+
+	if (rt->rt_desc->set_input != &triggerctrl_set_input) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (terminal_busy(rt) || reserved_by_other(rt, file))
+		err = -EBUSY;
+	else
+		rt->busy = true;
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	if (err)
+		goto out;
+
+	pulse_terminal(rt, &fire);
+
+	if (copy_to_user(arg, &fire, sizeof(fire)))
+		err = -EFAULT;
+	put_route_terminal(rt);
+	return err;
+out:
+	ni6674t_count(CTR_REJECTED_WRITES);
+	put_route_terminal(rt);
+	return err;
+}
+
+/*
+ * Terminal reservations.  A terminal reserved through an open file of the
+ * character device can only be changed through that file, with
+ * NI6674T_IOC_ROUTE, or through sysfs by the process that reserved it;
+ * everyone else's writes fail with -EBUSY.  The reservations are taken,
+ * dropped and checked under the board's route_lock, which writers hold
+ * until their change is committed.
+ */
+static long ni6674t_ioctl_reserve(struct ni6674t *dev, struct file *file,
+				  void __user *arg, bool reserve)
+{
+	struct ni6674t_reserve req;
+	struct route_terminal *rt;
+	struct pid *pid = NULL;
+	unsigned long flags;
+	int err = 0;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	req.terminal[sizeof(req.terminal) - 1] = '\0';
+	rt = get_route_terminal(dev, req.terminal);
+	if (!rt)
+		return -ENOENT;
+
+	if (reserve)
+		pid = get_pid(task_tgid(current));
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (reserved_by_other(rt, file)) {
+		err = -EBUSY;
+	} else if (!reserve && !rt->holder) {
+		err = -EINVAL;
+	} else {
+		/* The previous holder's pid is dropped below */
+		swap(pid, rt->holder_pid);
+		rt->holder = reserve ? file : NULL;
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+	put_pid(pid);
+
+	if (err == -EBUSY)
+		ni6674t_count(CTR_REJECTED_WRITES);
+	put_route_terminal(rt);
+	return err;
+}
+
+static long ni6674t_ioctl_route(struct ni6674t *dev, struct file *file,
+				void __user *arg)
+{
+	const struct route_terminal_input *in;
+	struct ni6674t_route_req req;
+	struct route_terminal *rt;
+	unsigned long flags;
+	int err = 0;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (req.reserved || (req.flags & ~NI6674T_ROUTE_INVERTED))
+		return -EINVAL;
+
+	req.terminal[sizeof(req.terminal) - 1] = '\0';
+	req.input[sizeof(req.input) - 1] = '\0';
+	rt = get_route_terminal(dev, req.terminal);
+	if (!rt)
+		return -ENOENT;
+
+	in = find_available_input(rt->rt_desc, req.input, strlen(req.input));
+	if (!in || ((req.flags & NI6674T_ROUTE_INVERTED) &&
+		    rt->rt_desc->set_input != &triggerctrl_set_input)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (validate_sync_mode(in, rt->sync_mode)) {
+		err = -EINVAL;
+	} else if (reserved_by_other(rt, file) || terminal_busy(rt)) {
+		err = -EBUSY;
+	} else {
+		if (rt->rt_desc->set_input == &triggerctrl_set_input)
+			set_terminal_polarity(rt,
+				(req.flags & NI6674T_ROUTE_INVERTED) ?
+				POLARITY_INVERTED : POLARITY_NORMAL);
+		set_input_and_update_state(rt, in);
+	}
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	if (!err)
+		notify_route_change(rt);
+out:
+	if (err)
+		ni6674t_count(CTR_REJECTED_WRITES);
+	put_route_terminal(rt);
+	return err;
+}
+
+/* Puts every terminal reserved through file back to its default route */
+static void release_reservations(struct ni6674t *dev, struct file *file)
+{
+	struct route_terminal *rt;
+	struct pid *pid;
+	unsigned long flags;
+	int i;
+
+	down_read(&dev->unbind_lock);
+	if (list_empty(&dev->node))
+		goto out;
+
+	for (i = 0; i < dev->terminals->count; i++) {
+		rt = &dev->terminals->rt[i];
+
+		spin_lock_irqsave(&dev->route_lock, flags);
+		if (rt->holder != file) {
+			spin_unlock_irqrestore(&dev->route_lock, flags);
+			continue;
+		}
+
+		rt->holder = NULL;
+		pid = rt->holder_pid;
+		rt->holder_pid = NULL;
+		set_terminal_polarity(rt, POLARITY_NORMAL);
+		set_input_and_update_state(rt,
+					   &rt->rt_desc->available_inputs[0]);
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+
+		put_pid(pid);
+		notify_route_change(rt);
+	}
+out:
+	up_read(&dev->unbind_lock);
+}
+
+/* The open file only keeps struct ni6674t around; once the board is
+ *   removed its terminals and registers are gone, so every command runs
+ *   under unbind_lock after checking the board is still bound. */
+static long ni6674t_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct ni6674t *dev = file->private_data;
+	long ret;
+
+	down_read(&dev->unbind_lock);
+	if (list_empty(&dev->node)) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	switch (cmd) {
+	case NI6674T_IOC_FIRE:
+		ret = ni6674t_ioctl_fire(dev, file, (void __user *)arg);
+		break;
+	case NI6674T_IOC_RESERVE:
+		ret = ni6674t_ioctl_reserve(dev, file, (void __user *)arg,
+					    true);
+		break;
+	case NI6674T_IOC_RELEASE:
+		ret = ni6674t_ioctl_reserve(dev, file, (void __user *)arg,
+					    false);
+		break;
+	case NI6674T_IOC_ROUTE:
+		ret = ni6674t_ioctl_route(dev, file, (void __user *)arg);
+		break;
+	default:
+		ret = -ENOTTY;
+	}
+out:
+	up_read(&dev->unbind_lock);
+	return ret;
+}
+
+static int ni6674t_open(struct inode *inode, struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+	struct ni6674t *dev = container_of(misc, struct ni6674t, miscdev);
+
+	/* The open file may outlive the board */
+	kref_get(&dev->ref);
+	file->private_data = dev;
+	return nonseekable_open(inode, file);
+}
+
+static int ni6674t_release(struct inode *inode, struct file *file)
+{
+	struct ni6674t *dev = file->private_data;
+
+	release_reservations(dev, file);
+	kref_put(&dev->ref, ni6674t_free);
+	return 0;
+}
+
+static const struct file_operations ni6674t_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ni6674t_open,
+	.release	= ni6674t_release,
+	.unlocked_ioctl	= ni6674t_ioctl,
+	.llseek		= no_llseek,
+};
+
+static int __devinit ni6674t_init_chardev(struct ni6674t *dev,
+					  struct pci_dev *pdev)
+{
+	int err;
+
+	dev->minor_id = ida_simple_get(&ni6674t_ida, 0, 0, GFP_KERNEL);
+	if (dev->minor_id < 0)
+		return dev->minor_id;
+
+	dev->miscdev.minor = MISC_DYNAMIC_MINOR;
+	dev->miscdev.fops = &ni6674t_fops;
+	dev->miscdev.parent = &pdev->dev;
+	dev->miscdev.name = kasprintf(GFP_KERNEL, "ni6674t%d", dev->minor_id);
+	if (!dev->miscdev.name) {
+		err = -ENOMEM;
+		goto fail_name;
+	}
+
+	err = misc_register(&dev->miscdev);
+	if (err)
+		goto fail_register;
+
+	return 0;
+
+fail_register:
+	kfree(dev->miscdev.name);
+fail_name:
+	ida_simple_remove(&ni6674t_ida, dev->minor_id);
+	return err;
+}
+
+static void ni6674t_release_chardev(struct ni6674t *dev)
+{
+	misc_deregister(&dev->miscdev);
+	kfree(dev->miscdev.name);
+	ida_simple_remove(&ni6674t_ida, dev->minor_id);
+}
+
+/*
+ * Cross-board routing.  PFI lines of different boards may be cabled to
+ * each other; the cables are described through the driver's 'cables'
+ * attribute, and a path between terminals of any bound boards is found
+ * and programmed through its 'route_path' attribute.
+ */
+#define BOARD_NAME_LEN		32
+
+/**
+ * struct ni6674t_cable - A cable between PFI lines of two boards
+ *
+ * @node:	Entry in ni6674t_cables.
+ * @board:	PCI names of the boards at either end.
+ * @pfi:	PFI line used at either end.
+ */
+struct ni6674t_cable {
+	struct list_head node;
+	char board[2][BOARD_NAME_LEN];
+	unsigned int pfi[2];
+};
+
+static LIST_HEAD(ni6674t_cables);
+static char *ni6674t_last_path;
+
+static unsigned int nr_terminal_ids(void)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++)
+		count += terminal_families[i].count;
+	return count;
+}
+
+static const struct route_terminal_desc *terminal_desc(unsigned int id)
+{
+	const struct terminal_family *f;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(terminal_families); i++) {
+		f = &terminal_families[i];
+		if (id < f->count)
+			return &f->descs[id];
+		id -= f->count;
+	}
+
+	return NULL;
+}
+
+/* Splits "<board>/<Terminal>" in place */
+static int split_board_terminal(char *str, char **board, char **terminal)
+{
+	char *slash = strrchr(str, '/');
+
+	if (!slash || slash == str || !slash[1])
+		return -EINVAL;
+
+	*slash = '\0';
+	*board = str;
+	*terminal = slash + 1;
+	return 0;
+}
+
+/* Called with ni6674t_devices_lock held */
+static struct ni6674t *find_board(const char *name)
+{
+	struct ni6674t *dev;
+
+	list_for_each_entry(dev, &ni6674t_devices, node)
+		if (!strcmp(pci_name(dev->pdev), name))
+			return dev;
+	return NULL;
+}
+
+static ssize_t cables_show(struct device_driver *drv, char *buf)
+{
+	struct ni6674t_cable *cable;
+	size_t total = 0;
+
+	mutex_lock(&ni6674t_devices_lock);
+	list_for_each_entry(cable, &ni6674t_cables, node)
+		total += scnprintf(buf + total, PAGE_SIZE - total,
+				   "%s/%s=%s/%s\n",
+				   cable->board[0],
+				   pfi_rt_desc[cable->pfi[0]].name,
+				   cable->board[1],
+				   pfi_rt_desc[cable->pfi[1]].name);
+	mutex_unlock(&ni6674t_devices_lock);
+
+	return total;
+}
+
+static int parse_cable_end(char *str, struct ni6674t_cable *cable, int end)
+{
+	char *board, *terminal;
+	int i;
+
+	if (split_board_terminal(str, &board, &terminal) ||
+	    strlen(board) >= BOARD_NAME_LEN)
+		return -EINVAL;
+
+	for (i = 0; i < ARRAY_SIZE(pfi_rt_desc); i++) {
+		if (!strcmp(pfi_rt_desc[i].name, terminal)) {
+			strcpy(cable->board[end], board);
+			cable->pfi[end] = i;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+/* Replaces the cable table with "<board>/PFIx=<board>/PFIy" lines */
+static ssize_t cables_store(struct device_driver *drv, const char *buf,
+			    size_t count)
+{
+	struct ni6674t_cable *cable, *tmp;
+	char *copy, *cur, *line, *eq;
+	LIST_HEAD(cables);
+	LIST_HEAD(old);
+	int err = 0;
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	cur = copy;
+	while (!err && (line = strsep(&cur, "\n;"))) {
+		line = strim(line);
+		if (!*line)
+			continue;
+
+		eq = strchr(line, '=');
+		cable = kzalloc(sizeof(*cable), GFP_KERNEL);
+		if (!cable) {
+			err = -ENOMEM;
+			break;
+		}
+		list_add_tail(&cable->node, &cables);
+
+		if (!eq) {
+			err = -EINVAL;
+			break;
+		}
+		*eq++ = '\0';
+
+		err = parse_cable_end(strim(line), cable, 0);
+		if (!err)
+			err = parse_cable_end(strim(eq), cable, 1);
+	}
+	kfree(copy);
+
+	/* Swap in the new table; the old one, or the rejected new one, is
+	 *   what gets freed */
+	if (!err) {
+		mutex_lock(&ni6674t_devices_lock);
+		list_splice_init(&ni6674t_cables, &old);
+		list_splice_init(&cables, &ni6674t_cables);
+		mutex_unlock(&ni6674t_devices_lock);
+	} else {
+		list_splice_init(&cables, &old);
+	}
+
+	list_for_each_entry_safe(cable, tmp, &old, node)
+		kfree(cable);
+
+	return err ? err : count;
+}
+
+static DRIVER_ATTR(cables, 0600, cables_show, cables_store);
+
+enum path_edge {
+	PATH_NONE,
+	PATH_END,
+	PATH_ROUTE,
+	PATH_CABLE,
+};
+
+/* How the signal at a node of the combined graph moves toward the end */
+struct path_step {
+	unsigned int next;
+	enum path_edge edge;
+};
+
+/* A terminal can carry a path if nothing is routed through it yet, or if
+ *   it already takes the input the path needs.  Called with the board's
+ *   route_lock held. */
+static bool terminal_can_carry(struct route_terminal *rt,
+			       const struct route_terminal_desc *input)
+{
+	if (terminal_busy(rt) || reserved_by_other_process(rt))
+		return false;
+	return rt->input == &rt->rt_desc->available_inputs[0] ||
+	       (input && rt->input->desc == input);
+}
+
+/*
+ * Searches backwards from dst over the graph of every board in boards[],
+ * where node = board * nids + terminal ID, and fills in how each reached
+ * node forwards the signal toward dst.
+ */
+static int solve_route_path(struct ni6674t **boards, int nboards, int nids,
+			    unsigned int src, unsigned int dst,
+			    struct path_step *steps, unsigned int *queue)
+{
+	const struct route_terminal_desc *desc;
+	const struct route_terminal_input *in;
+	struct ni6674t_cable *cable;
+	struct route_terminal *rt;
+	unsigned int head = 0, tail = 0, v, u;
+	int b, id, pfi, end, peer;
+
+	steps[dst].edge = PATH_END;
+	queue[tail++] = dst;
+
+	while (head < tail) {
+		v = queue[head++];
+		if (v == src)
+			return 0;
+
+		b = v / nids;
+		id = v % nids;
+		if (id >= boards[b]->terminals->count)
+			continue;	/* input-only sources can't be driven */
+
+		rt = &boards[b]->terminals->rt[id];
+		desc = rt->rt_desc;
+
+		for (in = desc->available_inputs; in && in->desc; in++) {
+			if (v != dst && !terminal_can_carry(rt, in->desc))
+				continue;
+
+			u = b * nids + terminal_id(in->desc);
+			if (steps[u].edge != PATH_NONE)
+				continue;
+
+			steps[u].next = v;
+			steps[u].edge = PATH_ROUTE;
+			queue[tail++] = u;
+		}
+
+		/* The line can also be driven from the far end of a cable, as
+		 *   long as this end stops driving it */
+		pfi = pfi_index(desc);
+		if (pfi < 0 || (v != dst && !terminal_can_carry(rt, NULL)))
+			continue;
+
+		list_for_each_entry(cable, &ni6674t_cables, node) {
+			for (end = 0; end < 2; end++) {
+				if (cable->pfi[end] != pfi ||
+				    strcmp(cable->board[end],
+					   pci_name(boards[b]->pdev)))
+					continue;
+
+				for (peer = 0; peer < nboards; peer++)
+					if (!strcmp(cable->board[!end],
+						    pci_name(boards[peer]->pdev)))
+						break;
+				if (peer == nboards)
+					continue;
+
+				u = peer * nids +
+				    terminal_id(&pfi_rt_desc[cable->pfi[!end]]);
+				if (steps[u].edge != PATH_NONE)
+					continue;
+
+				steps[u].next = v;
+				steps[u].edge = PATH_CABLE;
+				queue[tail++] = u;
+			}
+		}
+	}
+
+	return -ENOENT;
+}
+
+/* Takes the route_lock of every board in boards[], with interrupts off.
+ *   The order is that of ni6674t_devices, which holding
+ *   ni6674t_devices_lock keeps stable. */
+static void lock_boards(struct ni6674t **boards, int nboards,
+			unsigned long *flags)
+{
+	int i;
+
+	local_irq_save(*flags);
+	for (i = 0; i < nboards; i++)
+		spin_lock_nest_lock(&boards[i]->route_lock,
+				    &ni6674t_devices_lock);
+}
+
+static void unlock_boards(struct ni6674t **boards, int nboards,
+			  unsigned long flags)
 {
-	int err;
+	int i;
 
-	rt->owner = dev;
-	rt->rt_desc = desc;
-	rt->kobj.kset = dev->terminal_set;
+	for (i = nboards - 1; i >= 0; i--)
+		spin_unlock(&boards[i]->route_lock);
+	local_irq_restore(flags);
+}
 
-	err = kobject_init_and_add(&rt->kobj, ktype, NULL, desc->name);
-	if (!err) {
-		/* Put the terminal into a known route state */
-		set_input_and_update_state(rt, &desc->available_inputs[0]);
+/* Appends the path from src to a description in buf */
+static void describe_route_path(struct ni6674t **boards, int nids,
+				unsigned int src, struct path_step *steps,
+				char *buf, size_t size)
+{
+	size_t len = 0;
+	unsigned int u;
+
+	for (u = src; ; u = steps[u].next) {
+		len += scnprintf(buf + len, size - len, "%s/%s",
+				 pci_name(boards[u / nids]->pdev),
+				 terminal_desc(u % nids)->name);
+		if (steps[u].edge == PATH_END)
+			break;
+		len += scnprintf(buf + len, size - len, "%s",
+				 steps[u].edge == PATH_CABLE ? " => " : " -> ");
 	}
-	return err;
+	scnprintf(buf + len, size - len, "\n");
 }
 
-static int __devinit init_pxi_trig_terminals(struct ni6674t *dev)
+/*
+ * Finds a path from src to dst across every bound board and cable and
+ * programs it.  The polarity of the last terminal routed through
+ * triggerctrl is chosen so the signal arrives at dst with the requested
+ * polarity.  Called with ni6674t_devices_lock held; the path is
+ * searched for and committed with every board's route_lock held.
+ */
+static int route_path_locked(const char *src_board, const char *src_name,
+			     const char *dst_board, const char *dst_name,
+			     enum terminal_polarity polarity)
 {
-	int i, err;
-	for (i = 0; i < ARRAY_SIZE(dev->pxi_trig); ++i) {
-		dev->pxi_trig[i] = kzalloc(sizeof(*dev->pxi_trig[i]),
-					   GFP_KERNEL);
-		if (!dev->pxi_trig[i]) {
-			err = -ENOMEM;
-			goto fail_allocation;
+	struct route_assignment *hops = NULL;
+	struct path_step *steps = NULL;
+	struct ni6674t **boards = NULL;
+	struct ni6674t *dev, *src_dev, *dst_dev;
+	struct route_terminal *rt;
+	const struct route_terminal_desc *src_desc = NULL, *dst_desc = NULL;
+	unsigned int *queue = NULL, src = 0, dst = 0, u, v;
+	int i, nboards = 0, nids = nr_terminal_ids(), nhops = 0, last = -1;
+	int parity = POLARITY_NORMAL, err = 0;
+	unsigned long flags;
+	char *desc;
+
+	src_dev = find_board(src_board);
+	dst_dev = find_board(dst_board);
+	if (!src_dev || !dst_dev)
+		return -ENODEV;
+
+	for (i = 0; i < nids; i++) {
+		if (!strcmp(terminal_desc(i)->name, src_name))
+			src_desc = terminal_desc(i);
+		if (!strcmp(terminal_desc(i)->name, dst_name))
+			dst_desc = terminal_desc(i);
+	}
+	if (!src_desc || !dst_desc ||
+	    terminal_id(dst_desc) >= dst_dev->terminals->count)
+		return -ENOENT;
+
+	list_for_each_entry(dev, &ni6674t_devices, node)
+		nboards++;
+
+	boards = kcalloc(nboards, sizeof(*boards), GFP_KERNEL);
+	steps = kcalloc(nboards * nids, sizeof(*steps), GFP_KERNEL);
+	queue = kcalloc(nboards * nids, sizeof(*queue), GFP_KERNEL);
+	hops = kcalloc(nboards * nids, sizeof(*hops), GFP_KERNEL);
+	desc = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!boards || !steps || !queue || !hops || !desc) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	i = 0;
+	list_for_each_entry(dev, &ni6674t_devices, node) {
+		if (dev == src_dev)
+			src = i * nids + terminal_id(src_desc);
+		if (dev == dst_dev)
+			dst = i * nids + terminal_id(dst_desc);
+		boards[i++] = dev;
+	}
+
+	if (src == dst) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	lock_boards(boards, nboards, &flags);
+	err = solve_route_path(boards, nboards, nids, src, dst, steps, queue);
+	if (err)
+		goto out_unlock;
+
+	/* Turn the path into the route changes that make it up */
+	for (u = src; steps[u].edge != PATH_END; u = v) {
+		v = steps[u].next;
+		hops[nhops].rt = &boards[v / nids]->terminals->rt[v % nids];
+		hops[nhops].input = find_input_desc(hops[nhops].rt->rt_desc,
+				steps[u].edge == PATH_CABLE ? &rt_floating :
+				terminal_desc(u % nids));
+		if (!hops[nhops].input ||
+		    validate_sync_mode(hops[nhops].input,
+				       hops[nhops].rt->sync_mode)) {
+			err = -EINVAL;
+			goto out_unlock;
+		}
+		if (reserved_by_other_process(hops[nhops].rt)) {
+			err = -EBUSY;
+			goto out_unlock;
 		}
 
-		err = init_and_add_route_terminal(dev, &dev->pxi_trig[i]->rt,
-						  &pxi_trig_route_terminal_ktype,
-						  &pxi_trig_rt_desc[i]);
-		if (err)
-			goto fail_registration;
+		if (steps[u].edge == PATH_ROUTE &&
+		    hops[nhops].rt->rt_desc->set_input == &triggerctrl_set_input) {
+			if (last >= 0)
+				parity ^= hops[last].rt->polarity;
+			last = nhops;
+		}
+		nhops++;
+	}
+
+	if (last < 0 && polarity != POLARITY_NORMAL) {
+		err = -EINVAL;
+		goto out_unlock;
+	}
+	if (last >= 0) {
+		rt = hops[last].rt;
+		/* An intermediate terminal that is already carrying the signal
+		 *   is shared with other routes, which its polarity is part of */
+		if (last != nhops - 1 && rt->polarity != (parity ^ polarity) &&
+		    rt->input != &rt->rt_desc->available_inputs[0]) {
+			err = -EBUSY;
+			goto out_unlock;
+		}
+		set_terminal_polarity(rt, parity ^ polarity);
 	}
-	return 0;
 
-fail_registration:
-	kfree(dev->pxi_trig[i]);
-fail_allocation:
-	while (--i >= 0)
-		release_route_terminal(&dev->pxi_trig[i]->rt);
+	/* Program from the far end back, so the receiving end of every cable
+	 *   stops driving its line before the sending end starts */
+	for (i = nhops - 1; i >= 0; i--)
+		set_input_and_update_state(hops[i].rt, hops[i].input);
+	unlock_boards(boards, nboards, flags);
+
+	for (i = 0; i < nhops; i++)
+		notify_route_change(hops[i].rt);
+
+	describe_route_path(boards, nids, src, steps, desc, PAGE_SIZE);
+	kfree(ni6674t_last_path);
+	ni6674t_last_path = desc;
+	desc = NULL;
+	goto out;
+
+out_unlock:
+	unlock_boards(boards, nboards, flags);
+out:
+	kfree(desc);
+	kfree(hops);
+	kfree(queue);
+	kfree(steps);
+	kfree(boards);
 	return err;
 }
 
-static void release_pxi_trig_terminals(struct ni6674t *dev)
+static ssize_t route_path_show(struct device_driver *drv, char *buf)
 {
-	int i;
-	for (i = ARRAY_SIZE(dev->pxi_trig) - 1; i >= 0; --i)
-		release_route_terminal(&dev->pxi_trig[i]->rt);
+	ssize_t len;
+
+	mutex_lock(&ni6674t_devices_lock);
+	len = scnprintf(buf, PAGE_SIZE, "%s",
+			ni6674t_last_path ? ni6674t_last_path : "");
+	mutex_unlock(&ni6674t_devices_lock);
+
+	return len;
 }
 
-int init_route_terminals(struct ni6674t *dev,
-			 struct route_terminal *rt[],
-			 const size_t rt_size,
-			 const struct route_terminal_desc rtt[])
+/* Routes "<board>/<Terminal> <board>/<Terminal> [normal|inverted]" */
+static ssize_t route_path_store(struct device_driver *drv, const char *buf,
+				size_t count)
 {
-	int i, err;
-	for (i = 0; i < rt_size; ++i) {
-		rt[i] = kzalloc(sizeof(*rt[i]), GFP_KERNEL);
-		if (!rt[i]) {
-			err = -ENOMEM;
-			goto fail_allocation;
-		}
+	char *copy, *cur, *tok[3] = { NULL };
+	char *src_board, *src, *dst_board, *dst;
+	int n = 0, polarity = POLARITY_NORMAL, err;
 
-		err = init_and_add_route_terminal(dev, rt[i],
-						  &route_terminal_ktype,
-						  &rtt[i]);
-		if (err)
-			goto fail_registration;
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	cur = strim(copy);
+	while (n < ARRAY_SIZE(tok) && (tok[n] = strsep(&cur, " \t")))
+		if (*tok[n])
+			n++;
+
+	err = -EINVAL;
+	if (n < 2 || cur || split_board_terminal(tok[0], &src_board, &src) ||
+	    split_board_terminal(tok[1], &dst_board, &dst))
+		goto out;
+
+	if (n == 3) {
+		polarity = match_terminal_attr_str(terminal_polarity_strs,
+					ARRAY_SIZE(terminal_polarity_strs),
+					tok[2]);
+		if (polarity < 0)
+			goto out;
 	}
-	return 0;
 
-fail_registration:
-	kfree(rt[i]);
-fail_allocation:
-	while (--i >= 0)
-		release_route_terminal(rt[i]);
-	return err;
+	mutex_lock(&ni6674t_devices_lock);
+	err = route_path_locked(src_board, src, dst_board, dst, polarity);
+	mutex_unlock(&ni6674t_devices_lock);
+out:
+	kfree(copy);
+	return err ? err : count;
 }
 
-static int __devinit init_pfi_terminals(struct ni6674t *dev)
+static DRIVER_ATTR(route_path, 0600, route_path_show, route_path_store);
+
+/*
+ * In-kernel routing interface, see ni6674t_api.h.  Changes are validated
+ * the same way as writes to the terminals' attributes, and are checked and
+ * made under the board's route_lock.  unbind_lock keeps the board from
+ * being removed underneath the caller.
+ */
+int ni6674t_terminal_id(const char *name)
 {
-	return init_route_terminals(dev, dev->pfi, ARRAY_SIZE(dev->pfi),
-				    pfi_rt_desc);
+	int i, nids = nr_terminal_ids();
+
+	for (i = 0; i < nids; i++)
+		if (!strcmp(terminal_desc(i)->name, name))
+			return i;
+	return -ENOENT;
 }
+EXPORT_SYMBOL_GPL(ni6674t_terminal_id);
 
-static void release_pfi_terminals(struct ni6674t *dev)
+const char *ni6674t_terminal_name(int id)
 {
-	int i;
-	for (i = ARRAY_SIZE(dev->pfi) - 1; i >= 0; --i)
-		release_route_terminal(dev->pfi[i]);
+	if (id < 0 || id >= nr_terminal_ids())
+		return NULL;
+	return terminal_desc(id)->name;
 }
+EXPORT_SYMBOL_GPL(ni6674t_terminal_name);
 
-static int __devinit init_pxi_star_terminals(struct ni6674t *dev)
+struct ni6674t *ni6674t_get(const char *board)
 {
-	return init_route_terminals(dev, dev->pxi_star, ARRAY_SIZE(dev->pxi_star),
-				    pxi_star_rt_desc);
+	struct ni6674t *dev = NULL;
+
+	mutex_lock(&ni6674t_devices_lock);
+	if (board)
+		dev = find_board(board);
+	else if (!list_empty(&ni6674t_devices))
+		dev = list_first_entry(&ni6674t_devices, struct ni6674t, node);
+	if (dev)
+		kref_get(&dev->ref);
+	mutex_unlock(&ni6674t_devices_lock);
+
+	return dev;
 }
+EXPORT_SYMBOL_GPL(ni6674t_get);
 
-static void release_pxi_star_terminals(struct ni6674t *dev)
+void ni6674t_put(struct ni6674t *dev)
 {
-	int i;
-	for (i = ARRAY_SIZE(dev->pxi_star) - 1; i >= 0; --i)
-		release_route_terminal(dev->pxi_star[i]);
+	kref_put(&dev->ref, ni6674t_free);
 }
+EXPORT_SYMBOL_GPL(ni6674t_put);
 
-static int __devinit init_basic_terminal(struct ni6674t *dev, struct route_terminal** rt,
-					 const struct route_terminal_desc* desc)
+/* Resolves a route change, with the same checks as current_input_store.
+ *   Called with route_lock held. */
+static int resolve_route(struct ni6674t *dev, const struct ni6674t_route *route,
+			 struct route_assignment *change)
 {
-	int err;
-
-	*rt = kzalloc(sizeof(**rt), GFP_KERNEL);
-	if (!*rt) return -ENOMEM;
-
-	err = init_and_add_route_terminal(dev, *rt, &basic_route_terminal_ktype, desc);
-	if (err) kfree(*rt);
+	const struct route_terminal_desc *input;
+
+	if (route->terminal < 0 || route->terminal >= dev->terminals->count)
+		return -ENOENT;
+
+	change->rt = &dev->terminals->rt[route->terminal];
+	if (route->input == NI6674T_INPUT_DEFAULT) {
+		change->input = &change->rt->rt_desc->available_inputs[0];
+	} else {
+		input = route->input >= 0 ? terminal_desc(route->input) : NULL;
+		change->input = input ?
+			find_input_desc(change->rt->rt_desc, input) : NULL;
+		if (!change->input)
+			return -EINVAL;
+	}
 
-	return err;
+	if (validate_sync_mode(change->input, change->rt->sync_mode))
+		return -EINVAL;
+	if (terminal_busy(change->rt) || reserved_by_other(change->rt, NULL))
+		return -EBUSY;
+	return 0;
 }
 
-static int __devinit init_other_terminals(struct ni6674t *dev)
+int ni6674t_route_batch(struct ni6674t *dev,
+			const struct ni6674t_route *routes, int n)
 {
-	int i, err;
-
-	err = init_basic_terminal(dev, &dev->srca, &srca_rt_desc);
-	if (err)
-		goto fail_srca;
-
-	err = init_basic_terminal(dev, &dev->srcb, &srcb_rt_desc);
-	if (err)
-		goto fail_srcb;
+	struct route_assignment *changes;
+	unsigned long flags;
+	int i, err = 0;
 
-	err = init_basic_terminal(dev, &dev->srca_div_sel, &srca_div_sel_rt_desc);
-	if (err)
-		goto fail_srca_div_sel;
+	if (n <= 0)
+		return n ? -EINVAL : 0;
 
-	err = init_basic_terminal(dev, &dev->srcb_div_sel, &srcb_div_sel_rt_desc);
-	if (err)
-		goto fail_srcb_div_sel;
+	changes = kcalloc(n, sizeof(*changes), GFP_KERNEL);
+	if (!changes)
+		return -ENOMEM;
 
-	for (i = 0; i < ARRAY_SIZE(dev->bank); ++i) {
-		err = init_basic_terminal(dev, &dev->bank[i], &bank_rt_desc[i]);
-		if (err)
-			goto fail_bank;
+	down_read(&dev->unbind_lock);
+	if (list_empty(&dev->node)) {
+		err = -ENODEV;
+		goto out;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(dev->pxie_dstara); ++i) {
-		err = init_basic_terminal(dev, &dev->pxie_dstara[i], &dstara_rt_desc[i]);
-		if (err)
-			goto fail_dstara;
-	}
+	spin_lock_irqsave(&dev->route_lock, flags);
+	for (i = 0; i < n && !err; i++)
+		err = resolve_route(dev, &routes[i], &changes[i]);
 
-	/* FIXME: We're just enabling ClkIn by default here.  In the future,
-	 * we'll probably want to lazily enable ClkIn the first time it's used.
-	 * We'll probably also want to ref count it to make sure it's not
-	 * prematurely disabled. */
-	enable_clkin(dev);
+	if (!err)
+		for (i = 0; i < n; i++)
+			set_input_and_update_state(changes[i].rt,
+						   changes[i].input);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
 
-	return 0;
+	if (!err)
+		notify_route_changes(dev, changes, n);
+	else
+		ni6674t_count(CTR_REJECTED_WRITES);
+out:
+	up_read(&dev->unbind_lock);
 
-fail_dstara:
-	while (--i >= 0)
-		release_route_terminal(dev->pxie_dstara[i]);
-	i = ARRAY_SIZE(dev->bank);
-fail_bank:
-	while (--i >= 0)
-		release_route_terminal(dev->bank[i]);
-	release_route_terminal(dev->srcb_div_sel);
-fail_srcb_div_sel:
-	release_route_terminal(dev->srca_div_sel);
-fail_srca_div_sel:
-	release_route_terminal(dev->srcb);
-fail_srcb:
-	release_route_terminal(dev->srca);
-fail_srca:
+	kfree(changes);
 	return err;
 }
+EXPORT_SYMBOL_GPL(ni6674t_route_batch);
 
-static void release_other_terminals(struct ni6674t *dev)
+int ni6674t_route(struct ni6674t *dev, int terminal, int input)
 {
-	int i;
+	struct ni6674t_route route = {
+		.terminal	= terminal,
+		.input		= input,
+	};
 
-	for (i = ARRAY_SIZE(dev->pxie_dstara) - 1; i >= 0; --i)
-		release_route_terminal(dev->pxie_dstara[i]);
-
-	for (i = ARRAY_SIZE(dev->bank) - 1; i >= 0; --i)
-		release_route_terminal(dev->bank[i]);
+	return ni6674t_route_batch(dev, &route, 1);
+}
+EXPORT_SYMBOL_GPL(ni6674t_route);
 
-	release_route_terminal(dev->srcb_div_sel);
-	release_route_terminal(dev->srca_div_sel);
-	release_route_terminal(dev->srcb);
-	release_route_terminal(dev->srca);
+int ni6674t_unroute(struct ni6674t *dev, int terminal)
+{
+	return ni6674t_route(dev, terminal, NI6674T_INPUT_DEFAULT);
 }
+EXPORT_SYMBOL_GPL(ni6674t_unroute);
 
-static int __devinit ni6674t_dac_write(struct ni6674t *dev,
-				       struct pci_dev *pdev,
-				       u32 val)
+int ni6674t_set_polarity(struct ni6674t *dev, int terminal, bool inverted)
 {
-	u32 timeout = 100;
-	while ((ioread32(&dev->sync->dacctrl) & DAC_CTRL_SERIAL_PORT_BUSY) && --timeout)
-		udelay(10);
-	if (!timeout) {
-		dev_err(&pdev->dev, "DAC serial timeout.\n");
-		return -EIO;
+	struct route_terminal *rt;
+	unsigned long flags;
+	int err = 0;
+
+	down_read(&dev->unbind_lock);
+	if (list_empty(&dev->node)) {
+		err = -ENODEV;
+		goto out;
+	}
+	if (terminal < 0 || terminal >= dev->terminals->count) {
+		err = -ENOENT;
+		goto out;
 	}
 
-	iowrite32(val, &dev->sync->dacctrl);
-	return 0;
+	/* Only terminals routed through triggerctrl have a polarity */
+	rt = &dev->terminals->rt[terminal];
+	if (rt->rt_desc->set_input != &triggerctrl_set_input) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	spin_lock_irqsave(&dev->route_lock, flags);
+	if (terminal_busy(rt) || reserved_by_other(rt, NULL)) {
+		spin_unlock_irqrestore(&dev->route_lock, flags);
+		err = -EBUSY;
+		goto out;
+	}
+	set_terminal_polarity(rt, inverted ? POLARITY_INVERTED :
+					     POLARITY_NORMAL);
+	triggerctrl_flush_terminal_attrs(rt);
+	spin_unlock_irqrestore(&dev->route_lock, flags);
+
+	notify_route_change(rt);
+out:
+	up_read(&dev->unbind_lock);
+	return err;
 }
+EXPORT_SYMBOL_GPL(ni6674t_set_polarity);
 
-static int __devinit ni6674t_init_dac(struct ni6674t *dev,
-				      struct pci_dev *pdev)
+/* Feeds a bitstream to the configuration engine FIFO a word at a time */
+struct ce_stream {
+	struct ce *ce;
+	u8 word[4];
+	unsigned int nbytes;
+	u32 status;
+};
+
+static void __devinit ce_stream_push_word(struct ce_stream *cs)
 {
-	int pfinum, err;
-	/* FIXME: This code is mostly borrowed from the Windows driver
-	 * (w/ accompanying documentation).  Remember to document the meaning of
-    * these magic numbers. */
+	u32 word;
 
-	/* Set DAC_ChipSelect to PFI Threshold DAC */
-	/* Sets gain of output amplifier and reference selection options */
-	err = ni6674t_dac_write(dev, pdev, 0x800c);
-	if (err) return err;
+	memcpy(&word, cs->word, sizeof(word));
+	ni6674t_iowrite32(CTR_CE_WRITES, cpu_to_be32(word),
+			  &cs->ce->fifo);
+	ni6674t_count(CTR_FIFO_WORDS);
+	cs->status = ni6674t_ioread32(CTR_CE_READS, &cs->ce->status);
 
-	/* LDAC options */
-	err = ni6674t_dac_write(dev, pdev, 0xa000);
-	if (err) return err;
+	memset(cs->word, 0, sizeof(cs->word));
+	cs->nbytes = 0;
+}
 
-	/* Power-down options */
-	err = ni6674t_dac_write(dev, pdev, 0xc000);
-	if (err) return err;
+/* Returns false once the engine has asked for the download to stop */
+static bool __devinit ce_stream_write(struct ce_stream *cs, const u8 *data,
+				      size_t len)
+{
+	while (len--) {
+		if (cs->status & CE_STATUS_STOP_DOWNLOAD)
+			return false;
 
-	/* DAC Register Write (for each pfi line) */
-	for (pfinum=0; pfinum < 6; ++pfinum) {
-		err = ni6674t_dac_write(dev, pdev, (pfinum << 12) | (60 << 4));
-		if (err) return err;
+		cs->word[cs->nbytes++] = *data++;
+		if (cs->nbytes == sizeof(cs->word))
+			ce_stream_push_word(cs);
 	}
-	return 0;
+	return !(cs->status & CE_STATUS_STOP_DOWNLOAD);
 }
 
-static int __devinit ni6674t_init_sysfs(struct ni6674t *dev,
-					struct pci_dev *pdev)
+static const u8 fpga_xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+
+#define FPGA_XZ_CHUNK_SIZE	4096
+#define FPGA_XZ_DICT_MAX	(1 << 16)
+
+#if IS_ENABLED(CONFIG_XZ_DEC)
+/* Decompresses an xz image through one small buffer straight into the FIFO */
+static int __devinit ce_stream_write_xz(struct ce_stream *cs,
+					struct pci_dev *pdev,
+					const struct firmware *fw)
 {
+	struct xz_dec *xz;
+	struct xz_buf b;
+	enum xz_ret ret;
+	u8 *chunk;
 	int err = 0;
 
-	dev->terminal_set = kset_create_and_add("terminals", NULL,
-						&pdev->dev.kobj);
-	if (!dev->terminal_set) {
-		err = -ENOMEM;
-		goto fail_alloc_term_kset;
-	}
+	chunk = kmalloc(FPGA_XZ_CHUNK_SIZE, GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
 
-	err = init_pxi_trig_terminals(dev);
-	if (err) {
-		dev_err(&pdev->dev,
-			"Failed to initialize PXI Trig terminals.\n");
-		goto fail_pxi_trig_init;
+	xz = xz_dec_init(XZ_DYNALLOC, FPGA_XZ_DICT_MAX);
+	if (!xz) {
+		kfree(chunk);
+		return -ENOMEM;
 	}
 
-	err = init_pfi_terminals(dev);
-	if (err) {
-		dev_err(&pdev->dev, "Failed to initialize PFI terminals.\n");
-		goto fail_pfi_init;
-	}
+	b.in = fw->data;
+	b.in_pos = 0;
+	b.in_size = fw->size;
+	b.out = chunk;
+	b.out_size = FPGA_XZ_CHUNK_SIZE;
 
-	err = init_pxi_star_terminals(dev);
-	if (err) {
-		dev_err(&pdev->dev,
-			"Failed to initialize PXI Star terminals.\n");
-		goto fail_pxi_star_init;
-	}
+	do {
+		b.out_pos = 0;
+		ret = xz_dec_run(xz, &b);
+		if (!ce_stream_write(cs, chunk, b.out_pos))
+			break;
+	} while (ret == XZ_OK || ret == XZ_UNSUPPORTED_CHECK);
 
-	err = init_other_terminals(dev);
-	if (err) {
-		dev_err(&pdev->dev,
-			"Failed to initialize other terminals.\n");
-		goto fail_other_init;
+	if (ret != XZ_OK && ret != XZ_UNSUPPORTED_CHECK &&
+	    ret != XZ_STREAM_END) {
+		dev_err(&pdev->dev, "Corrupt FPGA image (xz error %d).\n", ret);
+		err = -EINVAL;
 	}
 
-	return 0;
-
-fail_other_init:
-	release_pxi_star_terminals(dev);
-fail_pxi_star_init:
-	/* PXI Star initialization failed and cleaned up after itself */
-	/* Need to clean up PFI terminals */
-	release_pfi_terminals(dev);
-fail_pfi_init:
-	/* PFI initialization failed and cleaned up after itself */
-	release_pxi_trig_terminals(dev);
-fail_pxi_trig_init:
-	kset_put(dev->terminal_set);
-fail_alloc_term_kset:
+	xz_dec_end(xz);
+	kfree(chunk);
 	return err;
 }
+#else
+static int __devinit ce_stream_write_xz(struct ce_stream *cs,
+					struct pci_dev *pdev,
+					const struct firmware *fw)
+{
+	dev_err(&pdev->dev, "FPGA image is xz compressed, but the kernel "
+		"was built without CONFIG_XZ_DEC.\n");
+	return -ENOEXEC;
+}
+#endif
 
 static int __devinit ni6674t_load_fpga(struct ni6674t *dev,
 				       struct pci_dev *pdev, const char *fw_str)
 {
-	int i, timeout, err, rem_bytes;
-	u32 status, *fwdata, tmp = 0;
+	struct ce_stream cs = { 0 };
+	int timeout, err;
+	u32 status, tmp;
 	const struct firmware *fw;
 	struct ce *ce;
 
@@ -1186,10 +6218,11 @@ static int __devinit ni6674t_load_fpga(struct ni6674t *dev,
 		goto fail_ce_map;
 	}
 
-	iowrite32((u32)pci_resource_start(pdev, 1) | MITE_IODWBSR_WENAB,
-		  &dev->mite->iodwbsr);
+	ni6674t_iowrite32(CTR_MITE_WRITES,
+			  (u32)pci_resource_start(pdev, 1) | MITE_IODWBSR_WENAB,
+			  &dev->mite->iodwbsr);
 
-	status = ioread32(&ce->status);
+	status = ni6674t_ioread32(CTR_CE_READS, &ce->status);
 
 	if ((status & (CE_STATUS_IN_RESET | CE_STATUS_IN_WAIT_START))
 		!= CE_STATUS_IN_WAIT_START) {
@@ -1198,28 +6231,31 @@ static int __devinit ni6674t_load_fpga(struct ni6674t *dev,
 		goto fail_ce_state;
 	}
 
-	iowrite32(CE_COMMAND_RESET_FIFO, &ce->command);
+	ni6674t_iowrite32(CTR_CE_WRITES, CE_COMMAND_RESET_FIFO, &ce->command);
 	mmiowb();
 
-	iowrite32(0, &ce->flash_info);
-	iowrite32(CE_PROG_PULSE_START_READY_IMMEDIATE |
-		  CE_PROG_PULSE_START_DRIVE_UNASSERT  |
-		  CE_PROG_PULSE_START_LEN(0x13), &ce->prog_pulse_config);
-	iowrite32(CE_DATA_DATA_CLKS(1)  |
-		  CE_DATA_ORDER_MSB2LSB |
-		  CE_DATA_ISPARALLEL, &ce->data_config);
-	iowrite32(CE_START_CLKRDY_DELAY(1), &ce->start_config);
-	iowrite32(CE_STOP_POSTCLKS(0x64) |
-		  CE_STOP_DONEHIGHTRUE   |
-		  CE_STOP_NOERRHIGHTRUE  |
-		  CE_STOP_DONERDY_IMMEDIATE, &ce->stop_config);
-	iowrite32(0, &ce->flash_addr);
+	ni6674t_iowrite32(CTR_CE_WRITES, 0, &ce->flash_info);
+	ni6674t_iowrite32(CTR_CE_WRITES, CE_PROG_PULSE_START_READY_IMMEDIATE |
+			  CE_PROG_PULSE_START_DRIVE_UNASSERT  |
+			  CE_PROG_PULSE_START_LEN(0x13),
+			  &ce->prog_pulse_config);
+	ni6674t_iowrite32(CTR_CE_WRITES, CE_DATA_DATA_CLKS(1)  |
+			  CE_DATA_ORDER_MSB2LSB |
+			  CE_DATA_ISPARALLEL, &ce->data_config);
+	ni6674t_iowrite32(CTR_CE_WRITES, CE_START_CLKRDY_DELAY(1),
+			  &ce->start_config);
+	ni6674t_iowrite32(CTR_CE_WRITES, CE_STOP_POSTCLKS(0x64) |
+			  CE_STOP_DONEHIGHTRUE   |
+			  CE_STOP_NOERRHIGHTRUE  |
+			  CE_STOP_DONERDY_IMMEDIATE, &ce->stop_config);
+	ni6674t_iowrite32(CTR_CE_WRITES, 0, &ce->flash_addr);
 	mmiowb();
 
-	iowrite32(CE_COMMAND_START_FPGA, &ce->command);
+	ni6674t_iowrite32(CTR_CE_WRITES, CE_COMMAND_START_FPGA, &ce->command);
 
 	timeout = 100;
-	while (!(ioread32(&ce->status) & CE_STATUS_IN_GEN_DATA) && --timeout)
+	while (!(ni6674t_ioread32(CTR_CE_READS, &ce->status) &
+		 CE_STATUS_IN_GEN_DATA) && --timeout)
 		mdelay(10);
 
 	if (!timeout) {
@@ -1228,20 +6264,20 @@ static int __devinit ni6674t_load_fpga(struct ni6674t *dev,
 		goto fail_ce_fpga_start;
 	}
 
-	fwdata = (u32*) fw->data;
-	for (i = 0; i < fw->size / 4; i++) {
-		iowrite32(cpu_to_be32(*fwdata++), &ce->fifo);
-		tmp = ioread32(&ce->status);
-		if (tmp & CE_STATUS_STOP_DOWNLOAD)
-			break;
+	cs.ce = ce;
+	if (fw->size >= sizeof(fpga_xz_magic) &&
+	    !memcmp(fw->data, fpga_xz_magic, sizeof(fpga_xz_magic))) {
+		err = ce_stream_write_xz(&cs, pdev, fw);
+		if (err)
+			goto fail_fpga_download;
+	} else {
+		ce_stream_write(&cs, fw->data, fw->size);
 	}
 
 	/* zero pad last word */
-	if (!(tmp & CE_STATUS_CONFIG_DONE) && (rem_bytes = fw->size & 3)) {
-		u32 mask = (1 << rem_bytes * 8) - 1;
-		iowrite32(cpu_to_be32(*fwdata & mask), &ce->fifo);
-		tmp = ioread32(&ce->status);
-	}
+	if (!(cs.status & CE_STATUS_CONFIG_DONE) && cs.nbytes)
+		ce_stream_push_word(&cs);
+	tmp = cs.status;
 
 	if (!(tmp & CE_STATUS_CONFIG_DONE)) {
 		/* dummy writes until signaled or timeout.  number of cycles
@@ -1249,8 +6285,10 @@ static int __devinit ni6674t_load_fpga(struct ni6674t *dev,
 		 * slop. 1100 should be enough. */
 		timeout = 1100;
 		while (--timeout) {
-			iowrite32(0xFFFFFFFF, &ce->fifo);
-			tmp = ioread32(&ce->status);
+			ni6674t_iowrite32(CTR_CE_WRITES, 0xFFFFFFFF,
+					  &ce->fifo);
+			ni6674t_count(CTR_FIFO_WORDS);
+			tmp = ni6674t_ioread32(CTR_CE_READS, &ce->status);
 			if (tmp & CE_STATUS_STOP_DOWNLOAD)
 				break;
 		}
@@ -1265,12 +6303,13 @@ static int __devinit ni6674t_load_fpga(struct ni6674t *dev,
 	iounmap(ce);
 	release_firmware(fw);
 
-	tmp = ioread32(&dev->mite->iodwbsr) & ~MITE_IODWBSR_WENAB;
-	iowrite32(tmp, &dev->mite->iodwbsr);
+	tmp = ni6674t_ioread32(CTR_MITE_READS,
+			       &dev->mite->iodwbsr) & ~MITE_IODWBSR_WENAB;
+	ni6674t_iowrite32(CTR_MITE_WRITES, tmp, &dev->mite->iodwbsr);
 
 	tmp = pci_resource_start(pdev, 1);
 	tmp |= MITE_IOWBSR1_WENAB | MITE_IOWBSR1_WSIZE4;
-	iowrite32(tmp, &dev->mite->iowbsr1);
+	ni6674t_iowrite32(CTR_MITE_WRITES, tmp, &dev->mite->iowbsr1);
 
 	return 0;
 
@@ -1287,6 +6326,8 @@ static int __devinit ni6674t_probe(struct pci_dev *pdev,
 				   const struct pci_device_id *id)
 {
 	const char *fw_str = (const char *) id->driver_data;
+	ktime_t probe_start = ktime_get();
+	ktime_t start = probe_start;
 	struct ni6674t *dev;
 	int err;
 
@@ -1297,6 +6338,9 @@ static int __devinit ni6674t_probe(struct pci_dev *pdev,
 	}
 
 	pci_set_drvdata(pdev, dev);
+	dev->pdev = pdev;
+	INIT_LIST_HEAD(&dev->node);
+	kref_init(&dev->ref);
 
 	err = pci_request_regions(pdev, "ni6674t");
 	if (err) {
@@ -1317,12 +6361,14 @@ static int __devinit ni6674t_probe(struct pci_dev *pdev,
 		err = -EIO;
 		goto fail_mite_map;
 	}
+	probe_phase_done(dev, PROBE_PHASE_MAP, &start);
 
 	err = ni6674t_load_fpga(dev, pdev, fw_str);
 	if (err) {
 		dev_err(&pdev->dev, "Could not load FPGA image.\n");
 		goto fail_load_fpga;
 	}
+	probe_phase_done(dev, PROBE_PHASE_FPGA, &start);
 
 	dev->sync = ioremap(pci_resource_start(pdev, 1),
 			    pci_resource_len(pdev, 1));
@@ -1330,14 +6376,18 @@ static int __devinit ni6674t_probe(struct pci_dev *pdev,
 		dev_err(&pdev->dev, "Could not map sync registers.\n");
 		goto fail_sync_map;
 	}
+	probe_phase_done(dev, PROBE_PHASE_MAP, &start);
 
 	mutex_init(&dev->devlock);
+	spin_lock_init(&dev->route_lock);
+	init_rwsem(&dev->unbind_lock);
 
 	err = ni6674t_init_dac(dev, pdev);
 	if (err) {
 		dev_err(&pdev->dev, "Could not init DAC.\n");
 		goto fail_init_dac;
 	}
+	probe_phase_done(dev, PROBE_PHASE_DAC, &start);
 
 	err = ni6674t_init_sysfs(dev, pdev);
 	if (err) {
@@ -1345,9 +6395,26 @@ static int __devinit ni6674t_probe(struct pci_dev *pdev,
 		goto fail_init_sysfs;
 	}
 
+	err = ni6674t_init_chardev(dev, pdev);
+	if (err) {
+		dev_err(&pdev->dev, "Could not register character device.\n");
+		goto fail_init_chardev;
+	}
+
+	mutex_lock(&ni6674t_devices_lock);
+	list_add_tail(&dev->node, &ni6674t_devices);
+	mutex_unlock(&ni6674t_devices_lock);
+
+	probe_phase_done(dev, PROBE_PHASE_TOTAL, &probe_start);
+	dev_dbg(&pdev->dev, "Probed in %llu us.\n",
+		(unsigned long long) div_u64(dev->probe_ns[PROBE_PHASE_TOTAL],
+					     NSEC_PER_USEC));
 	return 0;
 
+fail_init_chardev:
+	ni6674t_release_sysfs(dev);
 fail_init_sysfs:
+	cancel_work_sync(&dev->dac_work);
 fail_init_dac:
 	iounmap(dev->sync);
 fail_sync_map:
@@ -1367,20 +6434,247 @@ static void __devexit ni6674t_remove(struct pci_dev *pdev)
 {
 	struct ni6674t *dev = pci_get_drvdata(pdev);
 
-	release_other_terminals(dev);
-	release_pxi_star_terminals(dev);
-	release_pfi_terminals(dev);
-	release_pxi_trig_terminals(dev);
+	/* Waits for ioctls and in-kernel users that are programming routes */
+	down_write(&dev->unbind_lock);
+	mutex_lock(&ni6674t_devices_lock);
+	list_del_init(&dev->node);
+	mutex_unlock(&ni6674t_devices_lock);
+	up_write(&dev->unbind_lock);
 
-	kset_put(dev->terminal_set);
+	ni6674t_release_chardev(dev);
+	ni6674t_release_sysfs(dev);
+	cancel_work_sync(&dev->dac_work);
 	iounmap(dev->sync);
 	iounmap(dev->mite);
 	pci_disable_device(pdev);
 	pci_release_regions(pdev);
 	pci_set_drvdata(pdev, NULL);
-	kfree(dev);
+	kref_put(&dev->ref, ni6674t_free);
+}
+
+#if IS_ENABLED(CONFIG_PERF_EVENTS)
+/*
+ * The "ni6674t" perf PMU.  Its events are the driver event counters; they
+ * are system wide, so the PMU only takes per-CPU events, and advertises
+ * CPU 0 alone so that "perf stat -a" counts each of them once.
+ */
+static struct pmu ni6674t_pmu;
+static bool ni6674t_pmu_registered;
+
+static u64 ni6674t_counter_sum(unsigned int ctr)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu(ni6674t_counters[ctr], cpu);
+
+	return sum;
+}
+
+static void ni6674t_pmu_update(struct perf_event *event)
+{
+	u64 now = ni6674t_counter_sum(event->attr.config);
+	u64 prev = local64_xchg(&event->hw.prev_count, now);
+
+	local64_add(now - prev, &event->count);
+}
+
+static void ni6674t_pmu_event_destroy(struct perf_event *event)
+{
+	module_put(THIS_MODULE);
+}
+
+static int ni6674t_pmu_event_init(struct perf_event *event)
+{
+	if (event->attr.type != ni6674t_pmu.type)
+		return -ENOENT;
+
+	if (event->attr.config >= NR_COUNTERS)
+		return -EINVAL;
+
+	/* Nothing here can raise an interrupt, nor is tied to a task */
+	if (event->attr.sample_period || event->cpu < 0)
+		return -EINVAL;
+
+	/*
+	 * struct pmu has no owner field on the kernels this driver still
+	 * builds for, so each event pins the module itself until it is freed.
+	 */
+	if (!try_module_get(THIS_MODULE))
+		return -ENODEV;
+	event->destroy = ni6674t_pmu_event_destroy;
+
+	return 0;
+}
+
+static void ni6674t_pmu_start(struct perf_event *event, int flags)
+{
+	local64_set(&event->hw.prev_count,
+		    ni6674t_counter_sum(event->attr.config));
+	event->hw.state = 0;
+}
+
+static void ni6674t_pmu_stop(struct perf_event *event, int flags)
+{
+	if (event->hw.state & PERF_HES_STOPPED)
+		return;
+
+	ni6674t_pmu_update(event);
+	event->hw.state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static int ni6674t_pmu_add(struct perf_event *event, int flags)
+{
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+	if (flags & PERF_EF_START)
+		ni6674t_pmu_start(event, flags);
+
+	return 0;
+}
+
+static void ni6674t_pmu_del(struct perf_event *event, int flags)
+{
+	ni6674t_pmu_stop(event, PERF_EF_UPDATE);
+}
+
+static void ni6674t_pmu_read(struct perf_event *event)
+{
+	ni6674t_pmu_update(event);
+}
+
+static ssize_t ni6674t_pmu_event_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct perf_pmu_events_attr *pmu_attr =
+		container_of(attr, struct perf_pmu_events_attr, attr);
+
+	return sprintf(buf, "event=0x%02llx\n", (unsigned long long) pmu_attr->id);
+}
+
+#define NI6674T_PMU_EVENT(_name, _ctr)					\
+	static struct perf_pmu_events_attr ni6674t_pmu_event_##_name = {	\
+		.attr	= __ATTR(_name, 0444, ni6674t_pmu_event_show, NULL),	\
+		.id	= _ctr,							\
+	}
+
+NI6674T_PMU_EVENT(route_commits, CTR_ROUTE_COMMITS);
+NI6674T_PMU_EVENT(polarity_changes, CTR_POLARITY_CHANGES);
+NI6674T_PMU_EVENT(rejected_writes, CTR_REJECTED_WRITES);
+NI6674T_PMU_EVENT(dac_busy_spins, CTR_DAC_BUSY_SPINS);
+NI6674T_PMU_EVENT(fifo_words, CTR_FIFO_WORDS);
+NI6674T_PMU_EVENT(trig_reads, CTR_TRIG_READS);
+NI6674T_PMU_EVENT(trig_writes, CTR_TRIG_WRITES);
+NI6674T_PMU_EVENT(dstara_reads, CTR_DSTARA_READS);
+NI6674T_PMU_EVENT(dstara_writes, CTR_DSTARA_WRITES);
+NI6674T_PMU_EVENT(dac_reads, CTR_DAC_READS);
+NI6674T_PMU_EVENT(dac_writes, CTR_DAC_WRITES);
+NI6674T_PMU_EVENT(clkin_writes, CTR_CLKIN_WRITES);
+NI6674T_PMU_EVENT(ce_reads, CTR_CE_READS);
+NI6674T_PMU_EVENT(ce_writes, CTR_CE_WRITES);
+NI6674T_PMU_EVENT(mite_reads, CTR_MITE_READS);
+NI6674T_PMU_EVENT(mite_writes, CTR_MITE_WRITES);
+
+static struct attribute *ni6674t_pmu_event_attrs[] = {
+	&ni6674t_pmu_event_route_commits.attr.attr,
+	&ni6674t_pmu_event_polarity_changes.attr.attr,
+	&ni6674t_pmu_event_rejected_writes.attr.attr,
+	&ni6674t_pmu_event_dac_busy_spins.attr.attr,
+	&ni6674t_pmu_event_fifo_words.attr.attr,
+	&ni6674t_pmu_event_trig_reads.attr.attr,
+	&ni6674t_pmu_event_trig_writes.attr.attr,
+	&ni6674t_pmu_event_dstara_reads.attr.attr,
+	&ni6674t_pmu_event_dstara_writes.attr.attr,
+	&ni6674t_pmu_event_dac_reads.attr.attr,
+	&ni6674t_pmu_event_dac_writes.attr.attr,
+	&ni6674t_pmu_event_clkin_writes.attr.attr,
+	&ni6674t_pmu_event_ce_reads.attr.attr,
+	&ni6674t_pmu_event_ce_writes.attr.attr,
+	&ni6674t_pmu_event_mite_reads.attr.attr,
+	&ni6674t_pmu_event_mite_writes.attr.attr,
+	NULL,
+};
+
+static struct attribute_group ni6674t_pmu_events_group = {
+	.name	= "events",
+	.attrs	= ni6674t_pmu_event_attrs,
+};
+
+static ssize_t ni6674t_pmu_format_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "config:0-7\n");
+}
+
+static struct device_attribute ni6674t_pmu_format_event =
+	__ATTR(event, 0444, ni6674t_pmu_format_show, NULL);
+
+static struct attribute *ni6674t_pmu_format_attrs[] = {
+	&ni6674t_pmu_format_event.attr,
+	NULL,
+};
+
+static struct attribute_group ni6674t_pmu_format_group = {
+	.name	= "format",
+	.attrs	= ni6674t_pmu_format_attrs,
+};
+
+static ssize_t ni6674t_pmu_cpumask_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return sprintf(buf, "0\n");
 }
 
+static struct device_attribute ni6674t_pmu_cpumask =
+	__ATTR(cpumask, 0444, ni6674t_pmu_cpumask_show, NULL);
+
+static struct attribute *ni6674t_pmu_attrs[] = {
+	&ni6674t_pmu_cpumask.attr,
+	NULL,
+};
+
+static struct attribute_group ni6674t_pmu_attr_group = {
+	.attrs	= ni6674t_pmu_attrs,
+};
+
+static const struct attribute_group *ni6674t_pmu_attr_groups[] = {
+	&ni6674t_pmu_attr_group,
+	&ni6674t_pmu_events_group,
+	&ni6674t_pmu_format_group,
+	NULL,
+};
+
+static struct pmu ni6674t_pmu = {
+	.task_ctx_nr	= perf_invalid_context,
+	.attr_groups	= ni6674t_pmu_attr_groups,
+	.event_init	= ni6674t_pmu_event_init,
+	.add		= ni6674t_pmu_add,
+	.del		= ni6674t_pmu_del,
+	.start		= ni6674t_pmu_start,
+	.stop		= ni6674t_pmu_stop,
+	.read		= ni6674t_pmu_read,
+};
+
+static void ni6674t_pmu_register(void)
+{
+	/* The counters are only a diagnostic, so the driver works without */
+	if (perf_pmu_register(&ni6674t_pmu, "ni6674t", -1))
+		pr_warn("failed to register the perf PMU\n");
+	else
+		ni6674t_pmu_registered = true;
+}
+
+static void ni6674t_pmu_unregister(void)
+{
+	if (ni6674t_pmu_registered)
+		perf_pmu_unregister(&ni6674t_pmu);
+}
+#else
+static inline void ni6674t_pmu_register(void) { }
+static inline void ni6674t_pmu_unregister(void) { }
+#endif
+
 static struct pci_device_id ni6674t_pciids[] __devinitconst = {
 	{
 		PCI_DEVICE(PCI_VENDOR_ID_NI, 0x7405),
@@ -1398,13 +6692,45 @@ static struct pci_driver ni6674t_pci_driver = {
 
 static int __init ni6674t_init(void)
 {
+	int err;
+
 	pr_devel("driver loaded.\n");
-	return pci_register_driver(&ni6674t_pci_driver);
+	err = pci_register_driver(&ni6674t_pci_driver);
+	if (err)
+		return err;
+
+	err = driver_create_file(&ni6674t_pci_driver.driver, &driver_attr_cables);
+	if (err)
+		goto fail_cables;
+
+	err = driver_create_file(&ni6674t_pci_driver.driver,
+				 &driver_attr_route_path);
+	if (err)
+		goto fail_route_path;
+
+	ni6674t_pmu_register();
+	return 0;
+
+fail_route_path:
+	driver_remove_file(&ni6674t_pci_driver.driver, &driver_attr_cables);
+fail_cables:
+	pci_unregister_driver(&ni6674t_pci_driver);
+	return err;
 }
 
 static void __exit ni6674t_exit(void)
 {
+	struct ni6674t_cable *cable, *tmp;
+
+	ni6674t_pmu_unregister();
+	driver_remove_file(&ni6674t_pci_driver.driver, &driver_attr_route_path);
+	driver_remove_file(&ni6674t_pci_driver.driver, &driver_attr_cables);
 	pci_unregister_driver(&ni6674t_pci_driver);
+
+	list_for_each_entry_safe(cable, tmp, &ni6674t_cables, node)
+		kfree(cable);
+	kfree(ni6674t_last_path);
+	ida_destroy(&ni6674t_ida);
 }
 
 module_init(ni6674t_init);
@@ -38,7 +38,11 @@ struct route_terminal_input;
  * @dest_data			Data that can be used when programming this
  *				terminal's source
  * @line_state_bit		Offset of this terminal's line state within the
- *				3 trigread registers
+ *				3 trigread registers, or NO_LINE_STATE_BIT if
+ *				the terminal has no readback
+ * @latency_ns			Nominal propagation delay from the terminal's
+ *				input to its output, asynchronous mode
+ * @jitter_ns			Nominal peak-to-peak jitter added on the way
  */
 struct route_terminal_desc {
 	const char *name;
@@ -46,8 +50,12 @@ struct route_terminal_desc {
 	void (*set_input)(struct route_terminal *, const struct route_terminal_input *);
 	unsigned int dest_data;
 	unsigned int line_state_bit;
+	unsigned int latency_ns;
+	unsigned int jitter_ns;
 };
 
+#define NO_LINE_STATE_BIT	(~0U)
+
 /**
  * struct route_terminal_input - Structure used to describe an input to a terminal
  *
@@ -66,35 +74,96 @@ enum terminal_polarity {
 	POLARITY_INVERTED,
 };
 
+enum terminal_sync_mode {
+	SYNC_MODE_ASYNCHRONOUS,
+	SYNC_MODE_SYNCHRONOUS,
+};
+
+enum terminal_sync_clock {
+	SYNC_CLOCK_FULL,
+	SYNC_CLOCK_DIV1,
+	SYNC_CLOCK_DIV2,
+};
+
+enum terminal_sync_edge {
+	SYNC_EDGE_RISING,
+	SYNC_EDGE_FALLING,
+};
+
+struct file;
 struct ni6674t;
+struct pulse_generator;
+
+/* Upper bound on the number of terminals with a directory */
+#define ROUTE_TERMINALS_MAX	128
 
 /**
  * struct route_terminal - Run-time data about route terminal.
  *
- * @kobj:	Embedded struct kobject.
- * @rt_desc:	Pointer to the descriptor of this terminal.
  * @input:	Pointer to terminal currently driving this one.
- * @owner:	Pointer to device object which owns this terminal.
+ * @rt_desc:	Pointer to the descriptor of this terminal.
+ * @regval:	The triggerctrl word last written for this terminal.
+ * @id:		Terminal ID; also the terminal's index in its arena.
  * @polarity:	Whether or not the terminal is inverting the polarity of the signal.
+ * @sync_mode:	Whether the signal is passed through asynchronously or is
+ *		re-clocked to the sync clock.
+ * @sync_clock:	Which sync clock output is used when re-clocking.
+ * @sync_edge:	Which sync clock edge is used when re-clocking.
+ * @pxi_delay:	PXI trigger delay setting, for PXI_Trig and PXI_Star.
+ * @owner:	Pointer to device object which owns this terminal.
+ * @generator:	Pulse train configured on this terminal, if any.
+ * @holder:	Open file of the character device that has reserved this
+ *		terminal, or NULL.
+ * @holder_pid:	Process that took the reservation; its own sysfs writes
+ *		to the terminal are let through.
+ * @busy:	Claimed by a self-test, calibration or fired pulse that is
+ *		driving the line itself.
+ * @consumers:	IDs of the terminals whose current input is this one.
+ * @kobj:	Embedded struct kobject.
  */
 struct route_terminal {
-	struct kobject kobj;
-	const struct route_terminal_desc *rt_desc;
 	const struct route_terminal_input *input;
-	struct ni6674t *owner;
+	const struct route_terminal_desc *rt_desc;
+	u32 regval;
+	unsigned int id;
 	enum terminal_polarity polarity;
+	enum terminal_sync_mode sync_mode;
+	enum terminal_sync_clock sync_clock;
+	enum terminal_sync_edge sync_edge;
+	unsigned int pxi_delay;
+	struct ni6674t *owner;
+	struct pulse_generator *generator;
+	struct file *holder;
+	struct pid *holder_pid;
+	bool busy;
+	DECLARE_BITMAP(consumers, ROUTE_TERMINALS_MAX);
+	struct kobject kobj;
+};
+
+/**
+ * struct route_terminal_arena - All route terminals of a device
+ *
+ * @ref:	Held by the device and by each terminal's kobject, so the
+ *		arena stays around while any terminal is still referenced.
+ * @count:	Number of terminals in @rt.
+ * @rt:		The terminals, indexed by terminal ID.
+ */
+struct route_terminal_arena {
+	struct kref ref;
+	unsigned int count;
+	struct route_terminal rt[0] ____cacheline_aligned;
 };
 
 /**
- * struct pxi_trig_route_terminal
+ * struct route_assignment - A pending change of a terminal's input
  *
- * @rt:	Embedded struct route_terminal object.
+ * @rt:		The terminal being changed.
+ * @input:	The input it will be switched to.
  */
-struct pxi_trig_route_terminal {
-	struct route_terminal rt;
+struct route_assignment {
+	struct route_terminal *rt;
+	const struct route_terminal_input *input;
 };
-#define to_pxi_trig_rt(rt)					\
-	container_of(rt, struct pxi_trig_route_terminal, rt)
 
 /**
  * struct route_terminal_attr
@@ -128,4 +197,8 @@ struct route_terminal_attr route_terminal_attr_##_name = {	\
 	__ROUTE_TERMINAL_ATTR(_name, _mode,				\
 			      route_terminal_##_name##_show, NULL)	\
 
+#define ROUTE_TERMINAL_ATTR_WO(_name, _mode)				\
+	__ROUTE_TERMINAL_ATTR(_name, _mode,				\
+			      NULL, route_terminal_##_name##_store)	\
+
 #endif
@@ -0,0 +1,71 @@
+/*
+ * ni6674t_api.h: In-kernel routing interface for the NI PXIe-6674T
+ *
+ * (C) Copyright 2011 National Instruments Corp.
+ * Authors: Josh Cartwright <josh.cartwright@ni.com>,
+ *          Rick Ratzel <rick.ratzel@ni.com>,
+ *          Tyler Krehbiel <tyler.krehbiel@ni.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#ifndef _NI6674T_API_H_
+#define _NI6674T_API_H_
+
+#include <linux/types.h>
+
+struct ni6674t;
+
+/* Selects a terminal's default input, i.e. unroutes it */
+#define NI6674T_INPUT_DEFAULT		(-1)
+
+/**
+ * struct ni6674t_route - One route change of a batch
+ *
+ * @terminal:	ID of the terminal to route.
+ * @input:	ID of the input to select, or NI6674T_INPUT_DEFAULT.
+ */
+struct ni6674t_route {
+	int terminal;
+	int input;
+};
+
+/*
+ * Terminal IDs are the same on every board, and match the IDs in the
+ * topology.bin attribute.  Only terminals with a directory under
+ * terminals/ can be routed; any terminal can be an input.
+ */
+int ni6674t_terminal_id(const char *name);
+const char *ni6674t_terminal_name(int id);
+
+/*
+ * Looks up a bound board by its PCI name, or the first bound board if
+ * board is NULL.  The reference must be dropped with ni6674t_put(); once
+ * the board is removed, the calls below fail with -ENODEV.
+ */
+struct ni6674t *ni6674t_get(const char *board);
+void ni6674t_put(struct ni6674t *dev);
+
+int ni6674t_route(struct ni6674t *dev, int terminal, int input);
+int ni6674t_unroute(struct ni6674t *dev, int terminal);
+int ni6674t_set_polarity(struct ni6674t *dev, int terminal, bool inverted);
+
+/*
+ * Applies routes[0..n-1] as a unit: every change is validated before any
+ * is made, and the changes are announced with a single notification.
+ */
+int ni6674t_route_batch(struct ni6674t *dev,
+			const struct ni6674t_route *routes, int n);
+
+#endif /* _NI6674T_API_H_ */
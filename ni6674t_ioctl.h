@@ -0,0 +1,159 @@
+/*
+ * ni6674t_ioctl.h: Userspace interface definitions for the NI PXIe-6674T
+ *
+ * (C) Copyright 2011 National Instruments Corp.
+ * Authors: Josh Cartwright <josh.cartwright@ni.com>,
+ *          Rick Ratzel <rick.ratzel@ni.com>,
+ *          Tyler Krehbiel <tyler.krehbiel@ni.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#ifndef _NI6674T_IOCTL_H_
+#define _NI6674T_IOCTL_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define NI6674T_TERMINAL_NAME_LEN	32
+
+/**
+ * struct ni6674t_fire - Software trigger pulse on a terminal
+ *
+ * @terminal:	Name of the terminal to pulse, NUL terminated.
+ * @flags:	Set by the driver.  NI6674T_FIRE_OBSERVED if the asserted
+ *		level was read back from the line.
+ * @reserved:	Must be zero.
+ * @latency_ns:	Set by the driver.  Time from the start of the pulse until
+ *		the asserted level was read back from the line, or until the
+ *		write was flushed to the board if the terminal has no line
+ *		state readback.
+ */
+struct ni6674t_fire {
+	char terminal[NI6674T_TERMINAL_NAME_LEN];
+	__u32 flags;
+	__u32 reserved;
+	__u64 latency_ns;
+};
+
+#define NI6674T_FIRE_OBSERVED		(1 << 0)
+
+/**
+ * struct ni6674t_reserve - Terminal to reserve or release
+ *
+ * @terminal:	Name of the terminal, NUL terminated.
+ */
+struct ni6674t_reserve {
+	char terminal[NI6674T_TERMINAL_NAME_LEN];
+};
+
+/**
+ * struct ni6674t_route_req - Route change made by a reservation holder
+ *
+ * @terminal:	Name of the terminal to route, NUL terminated.
+ * @input:	Name of the input to select, NUL terminated.
+ * @flags:	NI6674T_ROUTE_INVERTED to invert the signal, for terminals
+ *		with a polarity attribute.
+ * @reserved:	Must be zero.
+ */
+struct ni6674t_route_req {
+	char terminal[NI6674T_TERMINAL_NAME_LEN];
+	char input[NI6674T_TERMINAL_NAME_LEN];
+	__u32 flags;
+	__u32 reserved;
+};
+
+#define NI6674T_ROUTE_INVERTED		(1 << 0)
+
+#define NI6674T_IOC_MAGIC		0xb6
+
+#define NI6674T_IOC_FIRE		_IOWR(NI6674T_IOC_MAGIC, 0x00, struct ni6674t_fire)
+#define NI6674T_IOC_RESERVE		_IOW(NI6674T_IOC_MAGIC, 0x01, struct ni6674t_reserve)
+#define NI6674T_IOC_RELEASE		_IOW(NI6674T_IOC_MAGIC, 0x02, struct ni6674t_reserve)
+#define NI6674T_IOC_ROUTE		_IOW(NI6674T_IOC_MAGIC, 0x03, struct ni6674t_route_req)
+
+/*
+ * Layout of the device's topology.bin attribute: a header, followed by
+ * num_terminals terminal records, num_edges edge records and a block of
+ * NUL-terminated names.  Offsets are in bytes from the start of the file
+ * and all fields are in host byte order.  A terminal's ID is its index in
+ * the terminal records.
+ */
+#define NI6674T_TOPO_MAGIC		0x5454364e	/* "N6TT" */
+#define NI6674T_TOPO_VERSION		2
+
+struct ni6674t_topo_header {
+	__u32 magic;
+	__u16 version;
+	__u16 header_size;
+	__u32 num_terminals;
+	__u32 terminals_offset;
+	__u32 num_edges;
+	__u32 edges_offset;
+	__u32 names_size;
+	__u32 names_offset;
+};
+
+/* Register programmed when a terminal's input changes */
+enum ni6674t_topo_reg {
+	NI6674T_TOPO_REG_NONE,
+	NI6674T_TOPO_REG_TRIGGERCTRL,
+	NI6674T_TOPO_REG_DSTARACTRL1,
+	NI6674T_TOPO_REG_DSTARACTRL2,
+};
+
+#define NI6674T_TOPO_HAS_DIRECTORY	(1 << 0)
+#define NI6674T_TOPO_LINE_STATE		(1 << 1)
+#define NI6674T_TOPO_POLARITY		(1 << 2)
+#define NI6674T_TOPO_SYNC		(1 << 3)
+#define NI6674T_TOPO_THRESHOLD		(1 << 4)
+
+/**
+ * struct ni6674t_topo_terminal - One terminal of the routing graph
+ *
+ * @name_offset:	Offset of the name within the names block.
+ * @first_edge:		Index of the terminal's first input edge.
+ * @num_edges:		Number of input edges; the first is the default.
+ * @reg:		An enum ni6674t_topo_reg.
+ * @flags:		NI6674T_TOPO_* capabilities.
+ * @dest_data:		Destination field or register mask programmed for
+ *			this terminal.
+ * @line_state_bit:	Bit within the trigread registers, or ~0.
+ * @latency_ns:		Nominal propagation delay through the terminal.
+ * @jitter_ns:		Nominal peak-to-peak jitter added by the terminal.
+ */
+struct ni6674t_topo_terminal {
+	__u32 name_offset;
+	__u32 first_edge;
+	__u16 num_edges;
+	__u8 reg;
+	__u8 flags;
+	__u32 dest_data;
+	__u32 line_state_bit;
+	__u32 latency_ns;
+	__u32 jitter_ns;
+};
+
+/**
+ * struct ni6674t_topo_edge - A possible input of a terminal
+ *
+ * @input_id:	ID of the input terminal.
+ * @data:	Source field value programmed to select the input.
+ */
+struct ni6674t_topo_edge {
+	__u32 input_id;
+	__u32 data;
+};
+
+#endif
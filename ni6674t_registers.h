@@ -76,6 +76,8 @@ struct ni_sync {
 /*00*/	NI6674_RESERVE_BYTES(0x24);
 /*24*/  u32 dacctrl;
 #define DAC_CTRL_SERIAL_PORT_BUSY       (1<<31)
+#define DAC_CTRL_WORD(addr, code)	(((addr)<<12) | ((code)<<4))
+#define DAC_CTRL_CODE_MAX		(0xff)
 /*28*/  u32 clkinctrl;
 #define CLKIN_CTRL_ENABLE(x)		((x)<<1)
 /*2c*/  NI6674_RESERVE_BYTES(0x08);
@@ -126,6 +128,7 @@ struct ni_sync {
 #define TRIG_CTRL_INVERTED		(1<<11)
 #define TRIG_CTRL_ENABLED		(1<<10)
 #define TRIG_CTRL_PXI_DELAY(x)		((x)<<7)
+#define TRIG_CTRL_PXI_DELAY_MAX		(7)
 /*54*/  NI6674_RESERVE_BYTES(0x0c);
 /*60*/  u32 trigread[3];
 #define TRIG_READ_PXI_STAR_LINE_STATE_BIT(n)	(n)
@@ -0,0 +1,403 @@
+/*
+ * libni6674t.c: Userspace client library for the NI PXIe-6674T driver
+ *
+ * (C) Copyright 2011 National Instruments Corp.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libni6674t.h"
+
+uint64_t ni6674t_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int is_device_dir(const char *dir)
+{
+	char path[NI6674T_PATH_MAX];
+	struct stat st;
+
+	if (snprintf(path, sizeof(path), "%s/terminals", dir) >= (int)sizeof(path))
+		return 0;
+	return !stat(path, &st) && S_ISDIR(st.st_mode);
+}
+
+int ni6674t_discover(char (*dirs)[NI6674T_PATH_MAX], int max)
+{
+	char path[NI6674T_PATH_MAX];
+	struct dirent *de;
+	int n = 0;
+	DIR *d;
+
+	d = opendir(NI6674T_DRIVER_DIR);
+	if (!d)
+		return -errno;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		if (snprintf(path, sizeof(path), "%s/%s", NI6674T_DRIVER_DIR,
+			     de->d_name) >= (int)sizeof(path) ||
+		    !is_device_dir(path))
+			continue;
+
+		if (n < max)
+			strcpy(dirs[n], path);
+		n++;
+	}
+
+	closedir(d);
+	return n;
+}
+
+static int open_attr(const char *dir, const char *term, const char *attr,
+		     int flags)
+{
+	char path[NI6674T_PATH_MAX];
+
+	if (snprintf(path, sizeof(path), "%s/terminals/%s/%s", dir, term,
+		     attr) >= (int)sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return open(path, flags | O_CLOEXEC);
+}
+
+/* Reads a whole attribute from offset 0; sysfs regenerates it each time */
+static ssize_t read_attr(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+
+	n = pread(fd, buf, len - 1, 0);
+	if (n < 0)
+		return -errno;
+
+	buf[n] = '\0';
+	if (n && buf[n - 1] == '\n')
+		buf[--n] = '\0';
+	return n;
+}
+
+static int load_inputs(const char *dir, struct ni6674t_terminal *t)
+{
+	char buf[8192], *tok, *save;
+	unsigned int n = 0;
+	ssize_t len;
+	int fd;
+
+	fd = open_attr(dir, t->name, "available_inputs", O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	len = read_attr(fd, buf, sizeof(buf));
+	close(fd);
+	if (len < 0)
+		return len;
+
+	for (tok = buf; *tok; tok++)
+		if (*tok == ' ')
+			n++;
+
+	t->inputs = calloc(n + 1, sizeof(*t->inputs));
+	t->input_ids = calloc(n + 1, sizeof(*t->input_ids));
+	if (!t->inputs || !t->input_ids)
+		return -ENOMEM;
+
+	n = 0;
+	for (tok = strtok_r(buf, " ", &save); tok;
+	     tok = strtok_r(NULL, " ", &save)) {
+		snprintf(t->inputs[n], NI6674T_NAME_MAX, "%s", tok);
+		t->input_ids[n++] = -1;
+	}
+	t->num_inputs = n;
+	return 0;
+}
+
+static int cmp_terminal(const void *a, const void *b)
+{
+	const struct ni6674t_terminal *ta = a, *tb = b;
+
+	return strcmp(ta->name, tb->name);
+}
+
+struct ni6674t_handle *ni6674t_open(const char *device_dir)
+{
+	char dirs[1][NI6674T_PATH_MAX], path[NI6674T_PATH_MAX];
+	struct ni6674t_handle *h;
+	struct ni6674t_terminal *t;
+	unsigned int i, j, cap = 0;
+	struct dirent *de;
+	int err = 0;
+	DIR *d;
+
+	if (!device_dir) {
+		if (ni6674t_discover(dirs, 1) < 1) {
+			errno = ENODEV;
+			return NULL;
+		}
+		device_dir = dirs[0];
+	}
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+	snprintf(h->path, sizeof(h->path), "%s", device_dir);
+
+	if (snprintf(path, sizeof(path), "%s/terminals", h->path) >= (int)sizeof(path))
+		d = NULL;
+	else
+		d = opendir(path);
+	if (!d) {
+		free(h);
+		return NULL;
+	}
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.' ||
+		    strlen(de->d_name) >= NI6674T_NAME_MAX)
+			continue;
+
+		if (h->num_terminals == cap) {
+			cap = cap ? cap * 2 : 64;
+			t = realloc(h->terminals, cap * sizeof(*t));
+			if (!t) {
+				err = -ENOMEM;
+				break;
+			}
+			h->terminals = t;
+		}
+
+		t = &h->terminals[h->num_terminals++];
+		memset(t, 0, sizeof(*t));
+		strcpy(t->name, de->d_name);
+		t->input_fd = open_attr(h->path, t->name, "current_input", O_RDWR);
+		t->polarity_fd = open_attr(h->path, t->name, "polarity", O_RDWR);
+		t->line_state_fd = open_attr(h->path, t->name, "line_state",
+					     O_RDONLY);
+		if (t->input_fd < 0) {
+			err = -errno;
+			break;
+		}
+
+		err = load_inputs(h->path, t);
+		if (err)
+			break;
+	}
+	closedir(d);
+
+	if (err) {
+		ni6674t_close(h);
+		errno = -err;
+		return NULL;
+	}
+
+	qsort(h->terminals, h->num_terminals, sizeof(*h->terminals),
+	      cmp_terminal);
+
+	/* Resolve the graph edges once the terminal table is final */
+	for (i = 0; i < h->num_terminals; i++) {
+		t = &h->terminals[i];
+		for (j = 0; j < t->num_inputs; j++)
+			t->input_ids[j] = ni6674t_find_terminal(h, t->inputs[j]);
+	}
+
+	return h;
+}
+
+void ni6674t_close(struct ni6674t_handle *h)
+{
+	struct ni6674t_terminal *t;
+	unsigned int i;
+
+	if (!h)
+		return;
+
+	for (i = 0; i < h->num_terminals; i++) {
+		t = &h->terminals[i];
+		if (t->input_fd >= 0)
+			close(t->input_fd);
+		if (t->polarity_fd >= 0)
+			close(t->polarity_fd);
+		if (t->line_state_fd >= 0)
+			close(t->line_state_fd);
+		free(t->inputs);
+		free(t->input_ids);
+	}
+	free(h->terminals);
+	free(h);
+}
+
+int ni6674t_find_terminal(const struct ni6674t_handle *h, const char *name)
+{
+	int lo = 0, hi = (int)h->num_terminals - 1, mid, c;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		c = strcmp(name, h->terminals[mid].name);
+		if (!c)
+			return mid;
+		if (c < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+int ni6674t_find_input(const struct ni6674t_terminal *t, const char *input)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->num_inputs; i++)
+		if (!strcmp(t->inputs[i], input))
+			return i;
+	return -1;
+}
+
+static int write_attr(int fd, const char *val)
+{
+	size_t len = strlen(val);
+	ssize_t n;
+
+	if (fd < 0)
+		return -ENOENT;
+
+	n = pwrite(fd, val, len, 0);
+	if (n < 0)
+		return -errno;
+	return n == (ssize_t)len ? 0 : -EIO;
+}
+
+int ni6674t_route(struct ni6674t_handle *h, int term, const char *input)
+{
+	struct ni6674t_terminal *t;
+
+	if (term < 0 || term >= (int)h->num_terminals)
+		return -ENOENT;
+
+	/* Reject what the driver would reject without a system call */
+	t = &h->terminals[term];
+	if (ni6674t_find_input(t, input) < 0)
+		return -EINVAL;
+
+	return write_attr(t->input_fd, input);
+}
+
+int ni6674t_set_polarity(struct ni6674t_handle *h, int term,
+			 const char *polarity)
+{
+	if (term < 0 || term >= (int)h->num_terminals)
+		return -ENOENT;
+
+	if (strcmp(polarity, "normal") && strcmp(polarity, "inverted"))
+		return -EINVAL;
+
+	return write_attr(h->terminals[term].polarity_fd, polarity);
+}
+
+int ni6674t_read_input(struct ni6674t_handle *h, int term, char *buf,
+		       size_t len)
+{
+	ssize_t n;
+
+	if (term < 0 || term >= (int)h->num_terminals)
+		return -ENOENT;
+
+	n = read_attr(h->terminals[term].input_fd, buf, len);
+	return n < 0 ? n : 0;
+}
+
+int ni6674t_read_line_state(struct ni6674t_handle *h, int term)
+{
+	char buf[8];
+	ssize_t n;
+	int fd;
+
+	if (term < 0 || term >= (int)h->num_terminals)
+		return -ENOENT;
+
+	fd = h->terminals[term].line_state_fd;
+	if (fd < 0)
+		return -ENOENT;
+
+	n = read_attr(fd, buf, sizeof(buf));
+	if (n < 0)
+		return n;
+	return buf[0] == '1';
+}
+
+int ni6674t_run_script(struct ni6674t_handle *h, FILE *f,
+		       ni6674t_op_cb cb, void *ctx)
+{
+	char line[256], value[NI6674T_NAME_MAX], *op, *term, *arg, *save;
+	struct ni6674t_op_result res;
+	unsigned int lineno = 0;
+	int failed = 0, idx;
+	uint64_t start;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		op = strtok_r(line, " \t\r\n", &save);
+		if (!op || op[0] == '#')
+			continue;
+		term = strtok_r(NULL, " \t\r\n", &save);
+		arg = strtok_r(NULL, " \t\r\n", &save);
+
+		memset(&res, 0, sizeof(res));
+		res.line = lineno;
+		res.op = op;
+		res.terminal = term ? term : "";
+		res.arg = arg;
+
+		idx = term ? ni6674t_find_terminal(h, term) : -1;
+
+		start = ni6674t_now_ns();
+		if (term && !strcmp(op, "route") && arg) {
+			res.err = ni6674t_route(h, idx, arg);
+		} else if (term && !strcmp(op, "polarity") && arg) {
+			res.err = ni6674t_set_polarity(h, idx, arg);
+		} else if (term && !strcmp(op, "get")) {
+			res.err = ni6674t_read_input(h, idx, value,
+						     sizeof(value));
+			res.arg = res.err ? NULL : value;
+		} else {
+			/* Report the line and go on with the rest */
+			res.malformed = 1;
+			res.err = -EINVAL;
+		}
+		res.elapsed_ns = ni6674t_now_ns() - start;
+
+		if (res.err)
+			failed++;
+		if (cb)
+			cb(&res, ctx);
+	}
+
+	return failed;
+}
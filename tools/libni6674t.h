@@ -0,0 +1,124 @@
+/*
+ * libni6674t.h: Userspace client library for the NI PXIe-6674T driver
+ *
+ * (C) Copyright 2011 National Instruments Corp.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#ifndef _LIBNI6674T_H_
+#define _LIBNI6674T_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define NI6674T_DRIVER_DIR	"/sys/bus/pci/drivers/ni6674t"
+#define NI6674T_NAME_MAX	32
+#define NI6674T_PATH_MAX	4096
+
+/**
+ * struct ni6674t_terminal - Cached state of one terminal directory
+ *
+ * @name:		Terminal name, e.g. "PXI_Trig0".
+ * @input_fd:		Open descriptor of current_input.
+ * @polarity_fd:	Open descriptor of polarity, or -1.
+ * @line_state_fd:	Open descriptor of line_state, or -1.
+ * @num_inputs:		Number of entries in @inputs and @input_ids.
+ * @inputs:		Names from available_inputs, default input first.
+ * @input_ids:		Index of each input in the handle's terminal table,
+ *			or -1 for inputs without a terminal directory, such
+ *			as 'floating' or 'ClkIn'.
+ */
+struct ni6674t_terminal {
+	char name[NI6674T_NAME_MAX];
+	int input_fd;
+	int polarity_fd;
+	int line_state_fd;
+	unsigned int num_inputs;
+	char (*inputs)[NI6674T_NAME_MAX];
+	int *input_ids;
+};
+
+/**
+ * struct ni6674t_handle - An opened board
+ *
+ * @path:		The device directory, e.g.
+ *			/sys/bus/pci/drivers/ni6674t/0000:05:0f.0
+ * @num_terminals:	Number of entries in @terminals.
+ * @terminals:		Terminals sorted by name.
+ */
+struct ni6674t_handle {
+	char path[NI6674T_PATH_MAX];
+	unsigned int num_terminals;
+	struct ni6674t_terminal *terminals;
+};
+
+/**
+ * struct ni6674t_op_result - Outcome of one scripted operation
+ *
+ * @line:	Script line number.
+ * @op:		Operation name ("route", "polarity" or "get").
+ * @terminal:	Terminal operated on.
+ * @arg:	Input or polarity written, or the value read for "get".
+ * @err:	0 on success, otherwise a negative errno value.
+ * @malformed:	Nonzero if the line could not be parsed; @err is -EINVAL.
+ * @elapsed_ns:	Time spent in the operation's system calls.
+ */
+struct ni6674t_op_result {
+	unsigned int line;
+	const char *op;
+	const char *terminal;
+	const char *arg;
+	int err;
+	int malformed;
+	uint64_t elapsed_ns;
+};
+
+typedef void (*ni6674t_op_cb)(const struct ni6674t_op_result *res, void *ctx);
+
+/* Fills @dirs with the device directories of up to @max bound boards and
+ * returns how many exist, or a negative errno value. */
+int ni6674t_discover(char (*dirs)[NI6674T_PATH_MAX], int max);
+
+/* Opens the board at @device_dir, or the first bound board if NULL. */
+struct ni6674t_handle *ni6674t_open(const char *device_dir);
+void ni6674t_close(struct ni6674t_handle *h);
+
+/* Returns the index of the named terminal, or -1. */
+int ni6674t_find_terminal(const struct ni6674t_handle *h, const char *name);
+
+/* Returns the index of @input within the terminal's inputs, or -1. */
+int ni6674t_find_input(const struct ni6674t_terminal *t, const char *input);
+
+int ni6674t_route(struct ni6674t_handle *h, int term, const char *input);
+int ni6674t_set_polarity(struct ni6674t_handle *h, int term,
+			 const char *polarity);
+int ni6674t_read_input(struct ni6674t_handle *h, int term, char *buf,
+		       size_t len);
+int ni6674t_read_line_state(struct ni6674t_handle *h, int term);
+
+/* Runs a route script from @f and reports each operation through @cb.
+ * Each line is one of
+ *	route <terminal> <input>
+ *	polarity <terminal> normal|inverted
+ *	get <terminal>
+ * Blank lines and lines starting with '#' are ignored.  A line that can't
+ * be parsed is reported as malformed and the script goes on.  Returns the
+ * number of failed or malformed lines. */
+int ni6674t_run_script(struct ni6674t_handle *h, FILE *f,
+		       ni6674t_op_cb cb, void *ctx);
+
+uint64_t ni6674t_now_ns(void);
+
+#endif
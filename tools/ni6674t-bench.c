@@ -0,0 +1,777 @@
+/*
+ * ni6674t-bench.c: Multithreaded route update load generator for the
+ *                  NI PXIe-6674T
+ *
+ * (C) Copyright 2011 National Instruments Corp.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libni6674t.h"
+#include "../ni6674t_ioctl.h"
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+enum bench_op {
+	OP_ROUTE,
+	OP_POLARITY,
+	OP_LINE_STATE,
+	NR_OPS,
+};
+
+static const char *op_names[NR_OPS] = {
+	[OP_ROUTE]	= "route",
+	[OP_POLARITY]	= "polarity",
+	[OP_LINE_STATE]	= "line_state",
+};
+
+/*
+ * How the driver programs a terminal, from the register topology.bin gives
+ * for it.  Every route or polarity change is checked and committed under
+ * the board's route_lock spinlock; triggerctrl terminals then take a single
+ * write of their own word, the DStarA fabric terminals a write of a
+ * control register they share, and hard-wired terminals such as
+ * PXIe_DStarA or SourceADivider write no register at all.  Line state reads
+ * take no lock.
+ */
+enum bench_path {
+	PATH_TRIGGERCTRL,
+	PATH_DSTARA,
+	PATH_HARDWIRED,
+	NR_PATHS,
+};
+
+static const char *path_names[NR_PATHS] = {
+	[PATH_TRIGGERCTRL]	= "triggerctrl",
+	[PATH_DSTARA]		= "dstara",
+	[PATH_HARDWIRED]	= "hardwired",
+};
+
+struct bench_sample {
+	uint32_t latency_ns;
+	uint8_t op;
+	uint8_t path;
+};
+
+struct bench_thread {
+	pthread_t thread;
+	unsigned int seed;
+	size_t count;
+	size_t cap;
+	struct bench_sample *samples;
+	unsigned long errors[NR_OPS];
+	int last_err;
+};
+
+static struct ni6674t_handle *h;
+static enum bench_path *term_paths;
+static int *terms;
+static unsigned int num_terms;
+static unsigned int mix[NR_OPS] = { 70, 20, 10 };
+static unsigned long ops_per_thread = 10000;
+static uint64_t deadline_ns;
+static pthread_barrier_t start_barrier;
+
+/* Simulated device: the board's route_lock is modeled in userspace, with a
+ * fixed cost per register access */
+static int simulated;
+static uint64_t sim_cost_ns = 2000;
+static pthread_mutex_t sim_route_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d DEVICE_DIR | -s SIM_DIR] [-t THREADS] [-n OPS | -D SECONDS]\n"
+		"          [-T PATTERN[,PATTERN...]] [-m ROUTE:POLARITY:LINE_STATE]\n"
+		"          [-c SIM_COST_NS]\n"
+		"\n"
+		"  -d  board to load, by device directory (default: first bound board)\n"
+		"  -s  create and load a simulated board in SIM_DIR instead\n"
+		"  -t  number of threads (default 4)\n"
+		"  -n  operations per thread (default 10000)\n"
+		"  -D  run for SECONDS instead of a fixed number of operations\n"
+		"  -T  terminals to operate on, as shell patterns (default: all)\n"
+		"  -m  relative weights of the operations (default 70:20:10)\n"
+		"  -c  cost of a simulated register access (default 2000 ns)\n",
+		prog);
+}
+
+static void spin_ns(uint64_t ns)
+{
+	uint64_t end = ni6674t_now_ns() + ns;
+
+	while (ni6674t_now_ns() < end)
+		;
+}
+
+static int write_file(const char *dir, const char *name, const char *val)
+{
+	char path[NI6674T_PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+	fprintf(f, "%s\n", val);
+	return fclose(f) ? -errno : 0;
+}
+
+static int read_file(const char *dir, const char *name, char **bufp,
+		     size_t *sizep)
+{
+	char path[NI6674T_PATH_MAX], *buf = NULL, *p;
+	size_t size = 0, cap = 0;
+	ssize_t n;
+	int fd, err = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	do {
+		if (size == cap) {
+			cap = cap ? cap * 2 : 16384;
+			p = realloc(buf, cap);
+			if (!p) {
+				err = -ENOMEM;
+				break;
+			}
+			buf = p;
+		}
+		n = read(fd, buf + size, cap - size);
+		if (n < 0)
+			err = -errno;
+		else
+			size += n;
+	} while (n > 0);
+
+	close(fd);
+	if (err) {
+		free(buf);
+		return err;
+	}
+	*bufp = buf;
+	*sizep = size;
+	return 0;
+}
+
+/*
+ * The simulated board follows the driver's descriptors for the terminals
+ * it has: the PXI triggers and PFIs with a reduced set of inputs, and the
+ * whole DStarA fabric.  Each PXIe_DStarA line is hard-wired to its bank.
+ */
+struct sim_terminal {
+	char name[NI6674T_NAME_MAX];
+	char inputs[256];
+	uint8_t reg;
+	uint8_t flags;
+};
+
+#define SIM_MAX_TERMINALS	48
+#define SIM_TRIGGERCTRL_FLAGS	(NI6674T_TOPO_HAS_DIRECTORY |		\
+				 NI6674T_TOPO_LINE_STATE |		\
+				 NI6674T_TOPO_POLARITY |		\
+				 NI6674T_TOPO_SYNC)
+
+static struct sim_terminal sim_terms[SIM_MAX_TERMINALS];
+static unsigned int sim_num_terms;
+
+static void sim_declare(const char *name, const char *inputs, uint8_t reg,
+			uint8_t flags)
+{
+	struct sim_terminal *st = &sim_terms[sim_num_terms++];
+
+	snprintf(st->name, sizeof(st->name), "%s", name);
+	snprintf(st->inputs, sizeof(st->inputs), "%s", inputs);
+	st->reg = reg;
+	st->flags = flags;
+}
+
+static int sim_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sim_num_terms; i++)
+		if (!strcmp(sim_terms[i].name, name))
+			return i;
+	return -1;
+}
+
+static int sim_add_terminal(const char *dir, const struct sim_terminal *st)
+{
+	char path[NI6674T_PATH_MAX], first[NI6674T_NAME_MAX];
+	int err;
+
+	snprintf(path, sizeof(path), "%s/terminals/%s", dir, st->name);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		return -errno;
+
+	sscanf(st->inputs, "%31s", first);
+	err = write_file(path, "available_inputs", st->inputs);
+	if (!err)
+		err = write_file(path, "current_input", first);
+	if (!err && (st->flags & NI6674T_TOPO_POLARITY))
+		err = write_file(path, "polarity", "normal");
+	if (!err && (st->flags & NI6674T_TOPO_LINE_STATE))
+		err = write_file(path, "line_state", "0");
+	return err;
+}
+
+/* Writes topology.bin for the simulated terminals.  Inputs without a
+ * terminal of their own, such as 'floating', get an input_id of ~0. */
+static int sim_write_topology(const char *dir)
+{
+	char path[NI6674T_PATH_MAX], input[NI6674T_NAME_MAX], *names;
+	struct ni6674t_topo_header *hdr;
+	struct ni6674t_topo_terminal *term;
+	struct ni6674t_topo_edge *edge;
+	size_t size, nedges = 0, names_size = 0;
+	const char *p;
+	unsigned int i;
+	int n, id, err = 0;
+	FILE *f;
+
+	for (i = 0; i < sim_num_terms; i++) {
+		names_size += strlen(sim_terms[i].name) + 1;
+		for (p = sim_terms[i].inputs; sscanf(p, "%31s%n", input, &n) == 1;
+		     p += n)
+			nedges++;
+	}
+
+	size = sizeof(*hdr) + sim_num_terms * sizeof(*term) +
+	       nedges * sizeof(*edge) + names_size;
+	hdr = calloc(1, size);
+	if (!hdr)
+		return -ENOMEM;
+
+	term = (struct ni6674t_topo_terminal *)(hdr + 1);
+	edge = (struct ni6674t_topo_edge *)(term + sim_num_terms);
+	names = (char *)(edge + nedges);
+
+	hdr->magic = NI6674T_TOPO_MAGIC;
+	hdr->version = NI6674T_TOPO_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->num_terminals = sim_num_terms;
+	hdr->terminals_offset = (char *)term - (char *)hdr;
+	hdr->num_edges = nedges;
+	hdr->edges_offset = (char *)edge - (char *)hdr;
+	hdr->names_size = names_size;
+	hdr->names_offset = names - (char *)hdr;
+
+	nedges = 0;
+	names_size = 0;
+	for (i = 0; i < sim_num_terms; i++, term++) {
+		term->name_offset = names_size;
+		term->first_edge = nedges;
+		term->reg = sim_terms[i].reg;
+		term->flags = sim_terms[i].flags;
+		term->line_state_bit = ~0u;
+		strcpy(names + names_size, sim_terms[i].name);
+		names_size += strlen(sim_terms[i].name) + 1;
+
+		for (p = sim_terms[i].inputs; sscanf(p, "%31s%n", input, &n) == 1;
+		     p += n, edge++, nedges++) {
+			id = sim_find(input);
+			edge->input_id = id < 0 ? ~0u : (unsigned int)id;
+		}
+		term->num_edges = nedges - term->first_edge;
+	}
+
+	snprintf(path, sizeof(path), "%s/topology.bin", dir);
+	f = fopen(path, "w");
+	if (!f) {
+		err = -errno;
+	} else {
+		if (fwrite(hdr, size, 1, f) != 1)
+			err = -EIO;
+		if (fclose(f) && !err)
+			err = -errno;
+	}
+	free(hdr);
+	return err;
+}
+
+/* Lays out a board directory with the simulated routing graph */
+static int sim_create(const char *dir)
+{
+	char path[NI6674T_PATH_MAX], name[NI6674T_NAME_MAX];
+	char bank[NI6674T_NAME_MAX];
+	static const char trig_inputs[] =
+		"floating logic_high logic_low PFI0 PFI1 PFI2 PFI3 PFI4 PFI5 "
+		"PXI_Star0 PXI_Star1 global_software local_software";
+	static const char pfi_inputs[] =
+		"floating logic_high logic_low PXI_Trig0 PXI_Trig1 PXI_Trig2 "
+		"PXI_Trig3 PXI_Trig4 PXI_Trig5 PXI_Trig6 PXI_Trig7";
+	unsigned int i;
+	int err = 0;
+
+	snprintf(path, sizeof(path), "%s/terminals", dir);
+	if ((mkdir(dir, 0755) && errno != EEXIST) ||
+	    (mkdir(path, 0755) && errno != EEXIST))
+		return -errno;
+
+	sim_num_terms = 0;
+	for (i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "PXI_Trig%u", i);
+		sim_declare(name, trig_inputs, NI6674T_TOPO_REG_TRIGGERCTRL,
+			    SIM_TRIGGERCTRL_FLAGS);
+	}
+	for (i = 0; i < 6; i++) {
+		snprintf(name, sizeof(name), "PFI%u", i);
+		sim_declare(name, pfi_inputs, NI6674T_TOPO_REG_TRIGGERCTRL,
+			    SIM_TRIGGERCTRL_FLAGS);
+	}
+	sim_declare("SourceA", "ClkIn", NI6674T_TOPO_REG_DSTARACTRL1,
+		    NI6674T_TOPO_HAS_DIRECTORY);
+	sim_declare("SourceB", "ClkIn", NI6674T_TOPO_REG_DSTARACTRL1,
+		    NI6674T_TOPO_HAS_DIRECTORY);
+	sim_declare("SourceADivider", "SourceA", NI6674T_TOPO_REG_NONE,
+		    NI6674T_TOPO_HAS_DIRECTORY);
+	sim_declare("SourceBDivider", "SourceB", NI6674T_TOPO_REG_NONE,
+		    NI6674T_TOPO_HAS_DIRECTORY);
+	sim_declare("SourceADividerSelect", "SourceA SourceADivider",
+		    NI6674T_TOPO_REG_DSTARACTRL2, NI6674T_TOPO_HAS_DIRECTORY);
+	sim_declare("SourceBDividerSelect", "SourceB SourceBDivider",
+		    NI6674T_TOPO_REG_DSTARACTRL2, NI6674T_TOPO_HAS_DIRECTORY);
+	for (i = 0; i < 4; i++) {
+		snprintf(name, sizeof(name), "Bank%u", i);
+		sim_declare(name,
+			    "floating SourceADividerSelect SourceBDividerSelect",
+			    NI6674T_TOPO_REG_DSTARACTRL1,
+			    NI6674T_TOPO_HAS_DIRECTORY);
+	}
+	/* Four lines per bank, with the last bank also taking line 16 */
+	for (i = 0; i < 17; i++) {
+		snprintf(name, sizeof(name), "PXIe_DStarA%u", i);
+		snprintf(bank, sizeof(bank), "Bank%u", i < 16 ? i / 4 : 3);
+		sim_declare(name, bank, NI6674T_TOPO_REG_NONE,
+			    NI6674T_TOPO_HAS_DIRECTORY);
+	}
+
+	for (i = 0; i < sim_num_terms && !err; i++)
+		err = sim_add_terminal(dir, &sim_terms[i]);
+	if (!err)
+		err = sim_write_topology(dir);
+	return err;
+}
+
+/* Classifies every terminal of the handle by the register topology.bin
+ * gives for it */
+static int load_terminal_paths(void)
+{
+	const struct ni6674t_topo_header *hdr;
+	const struct ni6674t_topo_terminal *term;
+	const char *names;
+	char *buf;
+	size_t size;
+	unsigned int i;
+	int err, idx;
+
+	err = read_file(h->path, "topology.bin", &buf, &size);
+	if (err)
+		return err;
+
+	hdr = (const struct ni6674t_topo_header *)buf;
+	if (size < sizeof(*hdr) || hdr->magic != NI6674T_TOPO_MAGIC ||
+	    hdr->version < NI6674T_TOPO_VERSION ||
+	    hdr->terminals_offset + (size_t)hdr->num_terminals *
+	    sizeof(*term) > size ||
+	    hdr->names_offset + (size_t)hdr->names_size > size) {
+		free(buf);
+		return -EINVAL;
+	}
+
+	term_paths = calloc(h->num_terminals, sizeof(*term_paths));
+	if (!term_paths) {
+		free(buf);
+		return -ENOMEM;
+	}
+
+	/* Anything topology.bin does not name is counted as a shared register */
+	for (i = 0; i < h->num_terminals; i++)
+		term_paths[i] = PATH_DSTARA;
+
+	term = (const struct ni6674t_topo_terminal *)
+		(buf + hdr->terminals_offset);
+	names = buf + hdr->names_offset;
+	for (i = 0; i < hdr->num_terminals; i++, term++) {
+		if (term->name_offset >= hdr->names_size ||
+		    !memchr(names + term->name_offset, '\0',
+			    hdr->names_size - term->name_offset))
+			continue;
+		idx = ni6674t_find_terminal(h, names + term->name_offset);
+		if (idx < 0)
+			continue;
+
+		switch (term->reg) {
+		case NI6674T_TOPO_REG_NONE:
+			term_paths[idx] = PATH_HARDWIRED;
+			break;
+		case NI6674T_TOPO_REG_TRIGGERCTRL:
+			term_paths[idx] = PATH_TRIGGERCTRL;
+			break;
+		default:
+			term_paths[idx] = PATH_DSTARA;
+			break;
+		}
+	}
+
+	free(buf);
+	return 0;
+}
+
+static enum bench_op pick_op(const struct ni6674t_terminal *t,
+			     unsigned int *seed)
+{
+	unsigned int total = 0, r, i;
+
+	for (i = 0; i < NR_OPS; i++)
+		total += mix[i];
+	r = rand_r(seed) % total;
+	for (i = 0; i < NR_OPS; i++) {
+		if (r < mix[i])
+			break;
+		r -= mix[i];
+	}
+
+	/* Fall back to a route where the terminal lacks the attribute */
+	if ((i == OP_POLARITY && t->polarity_fd < 0) ||
+	    (i == OP_LINE_STATE && t->line_state_fd < 0))
+		return OP_ROUTE;
+	return i;
+}
+
+static int run_op(enum bench_op op, int term, unsigned int *seed)
+{
+	struct ni6674t_terminal *t = &h->terminals[term];
+	enum bench_path path = term_paths[term];
+	int write = op != OP_LINE_STATE;
+	int err = 0;
+
+	if (simulated && write)
+		pthread_mutex_lock(&sim_route_lock);
+
+	switch (op) {
+	case OP_ROUTE:
+		err = ni6674t_route(h, term,
+				    t->inputs[rand_r(seed) % t->num_inputs]);
+		break;
+	case OP_POLARITY:
+		err = ni6674t_set_polarity(h, term, rand_r(seed) & 1 ?
+					   "inverted" : "normal");
+		break;
+	case OP_LINE_STATE:
+		err = ni6674t_read_line_state(h, term);
+		if (err > 0)
+			err = 0;
+		break;
+	default:
+		break;
+	}
+
+	/* Hard-wired terminals only ever select their single input, which
+	 *   touches no register */
+	if (simulated && path != PATH_HARDWIRED)
+		spin_ns(sim_cost_ns);
+	if (simulated && write)
+		pthread_mutex_unlock(&sim_route_lock);
+
+	return err;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_sample *s;
+	uint64_t start;
+	unsigned long i;
+	int term, err;
+	enum bench_op op;
+
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; deadline_ns ? ni6674t_now_ns() < deadline_ns :
+				  i < ops_per_thread; i++) {
+		if (bt->count == bt->cap) {
+			bt->cap = bt->cap ? bt->cap * 2 : 4096;
+			s = realloc(bt->samples, bt->cap * sizeof(*s));
+			if (!s)
+				break;
+			bt->samples = s;
+		}
+
+		term = terms[rand_r(&bt->seed) % num_terms];
+		op = pick_op(&h->terminals[term], &bt->seed);
+
+		start = ni6674t_now_ns();
+		err = run_op(op, term, &bt->seed);
+		s = &bt->samples[bt->count++];
+		s->latency_ns = ni6674t_now_ns() - start;
+		s->op = op;
+		s->path = term_paths[term];
+
+		if (err) {
+			bt->errors[op]++;
+			bt->last_err = err;
+		}
+	}
+
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report_latency(const char *label, uint32_t *lat, size_t n,
+			   double elapsed_s)
+{
+	if (!n)
+		return;
+
+	qsort(lat, n, sizeof(*lat), cmp_u32);
+	printf("%-22s %9zu %11.0f %8.1f %8.1f %8.1f %8.1f %8.1f\n", label, n,
+	       n / elapsed_s, lat[n / 2] / 1000.0, lat[n * 90 / 100] / 1000.0,
+	       lat[n * 99 / 100] / 1000.0, lat[n * 999 / 1000] / 1000.0,
+	       lat[n - 1] / 1000.0);
+}
+
+static void report(struct bench_thread *threads, unsigned int nthreads,
+		   double elapsed_s)
+{
+	unsigned long errors[NR_OPS] = { 0 };
+	char label[64];
+	uint32_t *lat;
+	size_t total = 0, n;
+	unsigned int t, op, path;
+	size_t i;
+
+	for (t = 0; t < nthreads; t++) {
+		total += threads[t].count;
+		for (op = 0; op < NR_OPS; op++)
+			errors[op] += threads[t].errors[op];
+	}
+
+	lat = malloc((total ? total : 1) * sizeof(*lat));
+	if (!lat)
+		return;
+
+	printf("%u threads, %zu operations in %.3f s\n\n", nthreads, total,
+	       elapsed_s);
+	printf("%-22s %9s %11s %8s %8s %8s %8s %8s\n", "operation", "count",
+	       "ops/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+
+	for (op = 0; op <= NR_OPS; op++) {
+		for (path = 0; path < NR_PATHS; path++) {
+			n = 0;
+			for (t = 0; t < nthreads; t++)
+				for (i = 0; i < threads[t].count; i++)
+					if ((op == NR_OPS ||
+					     threads[t].samples[i].op == op) &&
+					    threads[t].samples[i].path == path)
+						lat[n++] = threads[t].samples[i].latency_ns;
+
+			snprintf(label, sizeof(label), "%s/%s",
+				 op == NR_OPS ? "all" : op_names[op],
+				 path_names[path]);
+			report_latency(label, lat, n, elapsed_s);
+		}
+	}
+
+	n = 0;
+	for (t = 0; t < nthreads; t++)
+		for (i = 0; i < threads[t].count; i++)
+			lat[n++] = threads[t].samples[i].latency_ns;
+	report_latency("all", lat, n, elapsed_s);
+	free(lat);
+
+	printf("\nerrors:");
+	for (op = 0; op < NR_OPS; op++)
+		printf(" %s %lu", op_names[op], errors[op]);
+	printf("\n");
+	for (t = 0; t < nthreads; t++)
+		if (threads[t].last_err)
+			printf("thread %u: last error %s\n", t,
+			       strerror(-threads[t].last_err));
+}
+
+static int select_terminals(char *patterns)
+{
+	char *pats[64], *save;
+	unsigned int i, j, npats = 0;
+
+	terms = calloc(h->num_terminals, sizeof(*terms));
+	if (!terms)
+		return -ENOMEM;
+
+	if (patterns)
+		for (pats[0] = strtok_r(patterns, ",", &save);
+		     pats[npats] && npats < ARRAY_SIZE(pats) - 1;
+		     pats[++npats] = strtok_r(NULL, ",", &save))
+			;
+
+	for (i = 0; i < h->num_terminals; i++) {
+		for (j = 0; j < npats; j++)
+			if (!fnmatch(pats[j], h->terminals[i].name, 0))
+				break;
+		if (!npats || j < npats)
+			terms[num_terms++] = i;
+	}
+
+	return num_terms ? 0 : -ENOENT;
+}
+
+int main(int argc, char **argv)
+{
+	const char *device_dir = NULL, *sim_dir = NULL;
+	unsigned int nthreads = 4, t, seconds = 0;
+	struct bench_thread *threads;
+	char *patterns = NULL;
+	uint64_t start;
+	int opt, err;
+
+	while ((opt = getopt(argc, argv, "d:s:t:n:D:T:m:c:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			device_dir = optarg;
+			break;
+		case 's':
+			sim_dir = optarg;
+			break;
+		case 't':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			ops_per_thread = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			patterns = optarg;
+			break;
+		case 'm':
+			if (sscanf(optarg, "%u:%u:%u", &mix[OP_ROUTE],
+				   &mix[OP_POLARITY], &mix[OP_LINE_STATE]) != 3 ||
+			    !(mix[OP_ROUTE] + mix[OP_POLARITY] +
+			      mix[OP_LINE_STATE])) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'c':
+			sim_cost_ns = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!nthreads || optind != argc || (device_dir && sim_dir)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (sim_dir) {
+		err = sim_create(sim_dir);
+		if (err) {
+			fprintf(stderr, "Unable to create %s: %s\n", sim_dir,
+				strerror(-err));
+			return 1;
+		}
+		simulated = 1;
+		device_dir = sim_dir;
+	}
+
+	h = ni6674t_open(device_dir);
+	if (!h) {
+		fprintf(stderr, "Unable to open %s: %s\n",
+			device_dir ? device_dir : "ni6674t device",
+			strerror(errno));
+		return 1;
+	}
+
+	err = load_terminal_paths();
+	if (err) {
+		fprintf(stderr, "Unable to read %s/topology.bin: %s\n",
+			h->path, strerror(-err));
+		ni6674t_close(h);
+		return 1;
+	}
+
+	err = select_terminals(patterns);
+	if (err) {
+		fprintf(stderr, "No terminals to operate on: %s\n",
+			strerror(-err));
+		ni6674t_close(h);
+		return 1;
+	}
+
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!threads) {
+		ni6674t_close(h);
+		return 1;
+	}
+
+	printf("%s%s: %u of %u terminals, mix %u:%u:%u\n",
+	       simulated ? "simulated " : "", h->path, num_terms,
+	       h->num_terminals, mix[OP_ROUTE], mix[OP_POLARITY],
+	       mix[OP_LINE_STATE]);
+
+	pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+	for (t = 0; t < nthreads; t++) {
+		threads[t].seed = t + 1;
+		err = pthread_create(&threads[t].thread, NULL, bench_thread_fn,
+				     &threads[t]);
+		if (err) {
+			fprintf(stderr, "Unable to start thread: %s\n",
+				strerror(err));
+			exit(1);
+		}
+	}
+
+	start = ni6674t_now_ns();
+	if (seconds)
+		deadline_ns = start + seconds * 1000000000ull;
+	pthread_barrier_wait(&start_barrier);
+
+	for (t = 0; t < nthreads; t++)
+		pthread_join(threads[t].thread, NULL);
+
+	report(threads, nthreads, (ni6674t_now_ns() - start) / 1e9);
+
+	for (t = 0; t < nthreads; t++)
+		free(threads[t].samples);
+	free(threads);
+	free(terms);
+	free(term_paths);
+	ni6674t_close(h);
+	return 0;
+}
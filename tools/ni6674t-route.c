@@ -0,0 +1,189 @@
+/*
+ * ni6674t-route.c: Command line routing client for the NI PXIe-6674T
+ *
+ * (C) Copyright 2011 National Instruments Corp.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libni6674t.h"
+
+static int quiet;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d DEVICE_DIR] [-q] COMMAND\n"
+		"\n"
+		"commands:\n"
+		"  devices                       list bound boards\n"
+		"  terminals                     list terminals and their inputs\n"
+		"  route TERMINAL INPUT          set a terminal's current_input\n"
+		"  polarity TERMINAL POLARITY    set 'normal' or 'inverted'\n"
+		"  get TERMINAL                  read a terminal's current_input\n"
+		"  batch [FILE]                  run a route script (default stdin)\n"
+		"\n"
+		"Every operation is reported with the time spent in the driver.\n"
+		"-q suppresses the report for successful operations.\n",
+		prog);
+}
+
+static void report(const struct ni6674t_op_result *res, void *ctx)
+{
+	(void)ctx;
+
+	if (quiet && !res->err)
+		return;
+
+	if (res->malformed) {
+		fprintf(stderr, "%4u %s: malformed line\n", res->line,
+			res->op);
+		return;
+	}
+
+	printf("%4u %-8s %-20s %-20s %s %8.1f us\n", res->line, res->op,
+	       res->terminal, res->arg ? res->arg : "",
+	       res->err ? strerror(-res->err) : "ok",
+	       res->elapsed_ns / 1000.0);
+}
+
+static int list_devices(void)
+{
+	char dirs[16][NI6674T_PATH_MAX];
+	int i, n;
+
+	n = ni6674t_discover(dirs, 16);
+	if (n < 0) {
+		fprintf(stderr, "%s: %s\n", NI6674T_DRIVER_DIR, strerror(-n));
+		return 1;
+	}
+
+	for (i = 0; i < n && i < 16; i++)
+		printf("%s\n", dirs[i]);
+	return 0;
+}
+
+static int list_terminals(struct ni6674t_handle *h)
+{
+	char input[NI6674T_NAME_MAX];
+	unsigned int i, j;
+
+	for (i = 0; i < h->num_terminals; i++) {
+		if (ni6674t_read_input(h, i, input, sizeof(input)))
+			strcpy(input, "?");
+
+		printf("%-22s %-22s", h->terminals[i].name, input);
+		for (j = 0; j < h->terminals[i].num_inputs; j++)
+			printf(" %s", h->terminals[i].inputs[j]);
+		printf("\n");
+	}
+	return 0;
+}
+
+/* Runs a single operation through the same path as a one-line script */
+static int run_one(struct ni6674t_handle *h, const char *op,
+		   const char *term, const char *arg)
+{
+	char line[256];
+	FILE *f;
+	int ret;
+
+	snprintf(line, sizeof(line), "%s %s %s\n", op, term, arg ? arg : "");
+	f = fmemopen(line, strlen(line), "r");
+	if (!f)
+		return 1;
+
+	ret = ni6674t_run_script(h, f, report, NULL);
+	fclose(f);
+	return ret != 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *device_dir = NULL;
+	struct ni6674t_handle *h;
+	uint64_t start, open_ns;
+	int opt, ret = 1;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "d:qh")) != -1) {
+		switch (opt) {
+		case 'd':
+			device_dir = optarg;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[optind], "devices"))
+		return list_devices();
+
+	start = ni6674t_now_ns();
+	h = ni6674t_open(device_dir);
+	open_ns = ni6674t_now_ns() - start;
+	if (!h) {
+		fprintf(stderr, "Unable to open %s: %s\n",
+			device_dir ? device_dir : "ni6674t device",
+			strerror(errno));
+		return 1;
+	}
+
+	if (!quiet)
+		printf("opened %s: %u terminals in %.1f us\n", h->path,
+		       h->num_terminals, open_ns / 1000.0);
+
+	if (!strcmp(argv[optind], "terminals")) {
+		ret = list_terminals(h);
+	} else if (!strcmp(argv[optind], "batch")) {
+		f = optind + 1 < argc ? fopen(argv[optind + 1], "r") : stdin;
+		if (!f) {
+			perror(argv[optind + 1]);
+		} else {
+			start = ni6674t_now_ns();
+			ret = ni6674t_run_script(h, f, report, NULL);
+			if (!quiet)
+				printf("batch: %d failed, %.1f us total\n", ret,
+				       (ni6674t_now_ns() - start) / 1000.0);
+			ret = ret != 0;
+			if (f != stdin)
+				fclose(f);
+		}
+	} else if (optind + 1 < argc &&
+		   (!strcmp(argv[optind], "route") ||
+		    !strcmp(argv[optind], "polarity") ||
+		    !strcmp(argv[optind], "get"))) {
+		ret = run_one(h, argv[optind], argv[optind + 1],
+			      optind + 2 < argc ? argv[optind + 2] : NULL);
+	} else {
+		usage(argv[0]);
+	}
+
+	ni6674t_close(h);
+	return ret;
+}